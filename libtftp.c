@@ -0,0 +1,908 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include "libtftp.h"
+
+#define TFTP_PACKET_SIZE 516
+#define TFTP_BLOCK_SIZE LIBTFTP_BLOCK_SIZE
+
+// les codes operations
+#define TFTP_OPCODE_RRQ 1
+#define TFTP_OPCODE_WRQ 2
+#define TFTP_OPCODE_DATA 3
+#define TFTP_OPCODE_ACK 4
+#define TFTP_OPCODE_ERR 5
+#define TFTP_OPCODE_OACK 6
+
+#define TFTP_MAX_RETRIES 3
+#define TFTP_TIMEOUT_SECONDS 5
+// Envoi (put) : abandon après ce délai sans ACK nouveau, soit autant que
+// l'attente initiale et les TFTP_MAX_RETRIES retransmissions d'un transfert
+// sans fenêtre
+#define TFTP_RETRY_BUDGET_MS ((TFTP_MAX_RETRIES + 1) * TFTP_TIMEOUT_SECONDS * 1000.0)
+
+// Contrôle de congestion de l'envoi (put). La fenêtre est demandée au
+// serveur par l'option windowsize (RFC 7440) ; sans OACK elle reste à 1.
+#define CC_MAX_WINDOW 64
+#define CC_DUP_ACK_THRESHOLD 3
+#define CC_MIN_RTO_MS 200.0
+// Plafond du RTO initial et estimé : le serveur retransmet son ACK chaque
+// seconde, une perte isolée se rattrape donc en une seconde au plus
+#define CC_MAX_RTO_MS 1000.0
+// Plafond du backoff après timeouts successifs (RFC 6298 section 5.5) ; en
+// pratique TFTP_RETRY_BUDGET_MS borne l'attente bien avant
+#define CC_MAX_BACKOFF_MS 60000.0
+
+struct TFTP_Transfer {
+    TFTP_Options options;
+    char *remote_filename;
+    char *transfer_mode;
+
+    int sockfd;
+    struct sockaddr_in peer; // serveur, puis son TID après la première réponse
+    int connected;
+    int status;
+    int complete_pending; // terminé, on_complete pas encore appelé
+
+    TFTP_Error error;
+    int error_code; // errno ou code d'erreur TFTP selon error
+    char error_message[512];
+    char remote_message[TFTP_BLOCK_SIZE]; // texte du paquet ERROR reçu (TFTP_ERR_REMOTE)
+
+    char request[TFTP_PACKET_SIZE];
+    size_t request_length;
+    int retryCount;
+    double start_ms;
+    double deadline_ms;
+
+    // get : prochain bloc attendu, dernier ACK envoyé et tampon d'écriture
+    uint16_t expected_block;
+    uint8_t ack[4];
+    uint8_t *write_buffer;
+    size_t write_buffered;
+
+    // put : fenêtre d'émission, numéros de séquence sur 32 bits
+    // (le numéro de bloc sur le réseau est seq & 0xFFFF)
+    uint8_t (*blocks)[TFTP_PACKET_SIZE];
+    size_t block_len[CC_MAX_WINDOW];
+    double sent_at[CC_MAX_WINDOW];
+    int retransmitted[CC_MAX_WINDOW];
+    uint32_t base;        // plus ancien bloc non acquitté
+    uint32_t next;        // prochain bloc à envoyer
+    uint32_t read_upto;   // dernier bloc lu depuis la source
+    size_t block_fill;    // octets déjà lus du bloc read_upto + 1 (source non bloquante)
+    int source_blocked;   // la source a répondu EAGAIN : fenêtre arrêtée jusqu'au prochain appel
+    uint32_t last_seq;    // dernier bloc (< 512 octets), 0 si inconnu
+    uint32_t recover;     // fin de la phase de récupération en cours
+    int fast_recovery;    // retransmission rapide en cours : chaque ACK partiel renvoie le nouveau base
+    int backed_off;       // timeout sans ACK nouveau depuis : RTO doublé
+    double timer_start;
+    double progress_ms;   // dernier ACK nouveau (ou acceptation du WRQ)
+
+    TFTP_Stats stats;
+};
+
+// Horloge du transfert : monotone, ou fournie par options.clock (simulation)
+static double now_ms(const TFTP_Transfer *t) {
+    if (t->options.clock) {
+        return t->options.clock(t->options.net);
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void log_msg(TFTP_Transfer *t, const char *fmt, ...) {
+    if (t->options.on_log == NULL) {
+        return;
+    }
+    char message[600];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(message, sizeof(message), fmt, ap);
+    va_end(ap);
+    t->options.on_log(t, message, t->options.user);
+}
+
+// Fin du transfert. on_complete n'est appelé qu'au retour de la fonction
+// publique en cours (report), pour qu'il puisse libérer le transfert.
+static void finish(TFTP_Transfer *t, int status) {
+    t->status = status;
+    t->stats.elapsed_ms = now_ms(t) - t->start_ms;
+    t->complete_pending = 1;
+}
+
+// Dernière action des fonctions publiques : t n'est plus utilisé après on_complete
+static int report(TFTP_Transfer *t) {
+    int status = t->status;
+    if (t->complete_pending) {
+        t->complete_pending = 0;
+        if (t->options.on_complete) {
+            t->options.on_complete(t, status, t->options.user);
+        }
+    }
+    return status;
+}
+
+static void fail(TFTP_Transfer *t, TFTP_Error error, int code, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(t->error_message, sizeof(t->error_message), fmt, ap);
+    va_end(ap);
+    t->error = error;
+    t->error_code = code;
+    log_msg(t, "%s", t->error_message);
+    finish(t, LIBTFTP_FAILED);
+}
+
+static ssize_t net_send(TFTP_Transfer *t, const void *packet, size_t len) {
+    if (t->options.send) {
+        return t->options.send(t->options.net, packet, len, &t->peer);
+    }
+    return sendto(t->sockfd, packet, len, 0, (struct sockaddr*)&t->peer, sizeof(t->peer));
+}
+
+static void send_packet(TFTP_Transfer *t, const void *packet, size_t len) {
+    // Une socket pleine équivaut à une perte : la retransmission s'en chargera
+    if (net_send(t, packet, len) == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        fail(t, TFTP_ERR_SYSTEM, errno, "Erreur lors de l'envoi du paquet : %s", strerror(errno));
+    }
+}
+
+static void send_error(TFTP_Transfer *t, uint16_t errorCode, const char *errorMsg) {
+    uint8_t packet[TFTP_PACKET_SIZE];
+    size_t msg_len = strlen(errorMsg);
+    if (msg_len > TFTP_BLOCK_SIZE - 1) {
+        msg_len = TFTP_BLOCK_SIZE - 1;
+    }
+    *(uint16_t*)packet = htons(TFTP_OPCODE_ERR);
+    *(uint16_t*)(packet + 2) = htons(errorCode);
+    memcpy(packet + 4, errorMsg, msg_len);
+    packet[4 + msg_len] = '\0';
+    net_send(t, packet, msg_len + 5);
+}
+
+static ssize_t io_read(TFTP_Transfer *t, void *buf, size_t len) {
+    if (t->options.read) {
+        return t->options.read(t->options.io, buf, len);
+    }
+    return read(t->options.fd, buf, len);
+}
+
+static ssize_t io_write(TFTP_Transfer *t, const void *buf, size_t len) {
+    if (t->options.write) {
+        return t->options.write(t->options.io, buf, len);
+    }
+    return write(t->options.fd, buf, len);
+}
+
+// Lit un bloc complet (les lectures courtes ne signifient la fin que si read() retourne 0).
+// -1 avec errno EAGAIN : source non bloquante sans données pour l'instant ; les
+// octets déjà lus restent dans buf et la lecture reprend au prochain appel.
+static ssize_t read_block(TFTP_Transfer *t, uint8_t *buf) {
+    while (t->block_fill < TFTP_BLOCK_SIZE) {
+        ssize_t n = io_read(t, buf + t->block_fill, TFTP_BLOCK_SIZE - t->block_fill);
+        if (n == 0) {
+            break;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        t->block_fill += n;
+    }
+    size_t total = t->block_fill;
+    t->block_fill = 0;
+    return total;
+}
+
+static int write_all(TFTP_Transfer *t, const uint8_t *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = io_write(t, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Ajoute des données au tampon d'écriture, vidé lorsqu'il est plein ou si flush est demandé
+static int buffered_write(TFTP_Transfer *t, const uint8_t *buf, size_t len, int flush) {
+    if (t->write_buffer == NULL) {
+        return write_all(t, buf, len);
+    }
+    if (t->write_buffered + len > t->options.write_buffer_size) {
+        if (write_all(t, t->write_buffer, t->write_buffered) == -1) {
+            return -1;
+        }
+        t->write_buffered = 0;
+    }
+    memcpy(t->write_buffer + t->write_buffered, buf, len);
+    t->write_buffered += len;
+    if (flush || t->write_buffered == t->options.write_buffer_size) {
+        if (write_all(t, t->write_buffer, t->write_buffered) == -1) {
+            return -1;
+        }
+        t->write_buffered = 0;
+    }
+    return 0;
+}
+
+static size_t build_request(char *request, uint16_t opcode, const char *filename, const char *transfer_mode) {
+    size_t filename_length = strlen(filename);
+    size_t mode_length = strlen(transfer_mode);
+    size_t request_length = 2 + filename_length + 1 + mode_length + 1;
+
+    if (request_length > TFTP_PACKET_SIZE) {
+        return 0;
+    }
+
+    // Opcode, nom de fichier et mode de transfert terminés par un octet nul
+    request[0] = (char)(opcode >> 8);
+    request[1] = (char)(opcode & 0xFF);
+    memcpy(&request[2], filename, filename_length + 1);
+    memcpy(&request[3 + filename_length], transfer_mode, mode_length + 1);
+    return request_length;
+}
+
+// Contrôle de congestion AIMD de la fenêtre d'émission (put)
+static void cc_init(TFTP_CongestionControl *cc) {
+    memset(cc, 0, sizeof(*cc));
+    cc->cwnd = 1.0;
+    cc->ssthresh = CC_MAX_WINDOW;
+    cc->max_cwnd = cc->cwnd;
+    cc->max_window = 1;
+    cc->rto_ms = CC_MAX_RTO_MS;
+}
+
+static int cc_window(const TFTP_CongestionControl *cc) {
+    int window = (int)cc->cwnd;
+    if (window < 1) window = 1;
+    if (window > (int)cc->max_window) window = (int)cc->max_window;
+    return window;
+}
+
+// Estimation du RTT (RFC 6298), uniquement sur des blocs non retransmis (Karn)
+static void cc_on_rtt_sample(TFTP_CongestionControl *cc, double rtt_ms) {
+    if (cc->srtt_ms == 0) {
+        cc->srtt_ms = rtt_ms;
+        cc->rttvar_ms = rtt_ms / 2;
+    } else {
+        double delta = cc->srtt_ms - rtt_ms;
+        cc->rttvar_ms = 0.75 * cc->rttvar_ms + 0.25 * (delta < 0 ? -delta : delta);
+        cc->srtt_ms = 0.875 * cc->srtt_ms + 0.125 * rtt_ms;
+    }
+    cc->rto_ms = cc->srtt_ms + 4 * cc->rttvar_ms;
+    if (cc->rto_ms < CC_MIN_RTO_MS) cc->rto_ms = CC_MIN_RTO_MS;
+    if (cc->rto_ms > CC_MAX_RTO_MS) cc->rto_ms = CC_MAX_RTO_MS;
+}
+
+// Nouvel ACK : slow start jusqu'à ssthresh, puis augmentation additive
+static void cc_on_ack(TFTP_CongestionControl *cc, uint32_t acked_blocks) {
+    cc->dup_acks = 0;
+    while (acked_blocks-- > 0) {
+        if (cc->cwnd < cc->ssthresh) {
+            cc->cwnd += 1.0;
+        } else {
+            cc->cwnd += 1.0 / cc->cwnd;
+        }
+    }
+    if (cc->cwnd > CC_MAX_WINDOW) cc->cwnd = CC_MAX_WINDOW;
+    if (cc->cwnd > cc->max_cwnd) cc->max_cwnd = cc->cwnd;
+}
+
+// ACK dupliqué : retourne 1 s'il faut déclencher une retransmission rapide.
+// Avec une petite fenêtre, un seul bloc perdu ou doublé ne produit qu'un ACK
+// dupliqué, qui suffit alors ; seul le bloc manquant est renvoyé, une
+// fausse alerte due au réordonnancement ne coûte donc qu'un bloc.
+// Sans fenêtre, les ACK dupliqués sont ignorés (syndrome de l'apprenti sorcier, RFC 1123).
+static int cc_on_dup_ack(TFTP_CongestionControl *cc, int in_recovery) {
+    cc->total_dup_acks++;
+    if (in_recovery || cc->max_window == 1) {
+        return 0;
+    }
+    unsigned threshold = cc->cwnd < CC_DUP_ACK_THRESHOLD + 1 ? 1 : CC_DUP_ACK_THRESHOLD;
+    if (++cc->dup_acks < threshold) {
+        return 0;
+    }
+    // Diminution multiplicative ; avec cwnd < 4, le plancher de ssthresh
+    // dépasserait cwnd, qui ne doit jamais augmenter sur une perte
+    cc->ssthresh = cc->cwnd / 2 < 2 ? 2 : cc->cwnd / 2;
+    if (cc->cwnd > cc->ssthresh) cc->cwnd = cc->ssthresh;
+    cc->dup_acks = 0;
+    cc->fast_retransmits++;
+    return 1;
+}
+
+static void cc_on_timeout(TFTP_CongestionControl *cc) {
+    cc->ssthresh = cc->cwnd / 2 < 2 ? 2 : cc->cwnd / 2;
+    cc->cwnd = 1.0;
+    cc->dup_acks = 0;
+    cc->timeouts++;
+    // Backoff exponentiel du délai de retransmission, jusqu'au prochain
+    // échantillon de RTT
+    cc->rto_ms *= 2;
+    if (cc->rto_ms > CC_MAX_BACKOFF_MS) cc->rto_ms = CC_MAX_BACKOFF_MS;
+}
+
+void tftp_print_stats(FILE *out, const TFTP_Stats *stats) {
+    const TFTP_CongestionControl *cc = &stats->cc;
+    fprintf(out, "--- Statistiques de transfert ---\n");
+    fprintf(out, "Octets transférés    : %zu en %.1f ms (%.1f Ko/s)\n", stats->bytes, stats->elapsed_ms,
+            stats->elapsed_ms > 0 ? stats->bytes / stats->elapsed_ms * 1000.0 / 1024.0 : 0.0);
+    fprintf(out, "Paquets DATA envoyés : %lu (dont %lu retransmis)\n", cc->blocks_sent, cc->retransmits);
+    fprintf(out, "ACK dupliqués        : %lu, retransmissions rapides : %lu, timeouts : %lu\n",
+            cc->total_dup_acks, cc->fast_retransmits, cc->timeouts);
+    fprintf(out, "Fenêtre              : finale %.2f, max %.2f, ssthresh %.2f, acceptée par le serveur %u\n",
+            cc->cwnd, cc->max_cwnd, cc->ssthresh, cc->max_window);
+    fprintf(out, "RTT lissé            : %.3f ms (rttvar %.3f ms, RTO %.1f ms)\n", cc->srtt_ms, cc->rttvar_ms, cc->rto_ms);
+}
+
+static void progress(TFTP_Transfer *t) {
+    if (t->options.on_progress) {
+        t->stats.elapsed_ms = now_ms(t) - t->start_ms;
+        t->options.on_progress(t, &t->stats, t->options.user);
+    }
+}
+
+// Réception d'un paquet DATA (get)
+static void receive_data_packet(TFTP_Transfer *t, const uint8_t *buffer, size_t recvlen) {
+    uint16_t block_num = ntohs(*(uint16_t*)(buffer + 2));
+    log_msg(t, "Paquet DATA [%d] : Données reçues (Taille: %zu) du port %d", block_num, recvlen, ntohs(t->peer.sin_port));
+
+    if (block_num == t->expected_block) {
+        // Le dernier bloc vide le tampon avant son ACK : une erreur d'écriture peut encore être signalée au serveur
+        int last = recvlen < TFTP_PACKET_SIZE;
+        if (buffered_write(t, buffer + 4, recvlen - 4, last) == -1) {
+            int err = errno;
+            send_error(t, 3, "Erreur lors de l'écriture du fichier"); // Disk full or allocation exceeded
+            fail(t, TFTP_ERR_SYSTEM, err, "Erreur lors de l'écriture du fichier : %s", strerror(err));
+            return;
+        }
+
+        // Envoi de l'ACK au serveur
+        *(uint16_t*)t->ack = htons(TFTP_OPCODE_ACK);
+        *(uint16_t*)(t->ack + 2) = htons(block_num);
+        send_packet(t, t->ack, sizeof(t->ack));
+
+        t->expected_block++;
+        t->retryCount = 0;
+        t->deadline_ms = now_ms(t) + TFTP_TIMEOUT_SECONDS * 1000.0;
+        t->stats.bytes += recvlen - 4;
+        t->stats.blocks++;
+        progress(t);
+
+        if (last && t->status == LIBTFTP_RUNNING) {
+            log_msg(t, "Fin de la transmission.");
+            finish(t, LIBTFTP_DONE);
+        }
+    } else if (block_num == (uint16_t)(t->expected_block - 1)) {
+        // Envoi de l'ACK au serveur (ACK répété)
+        send_packet(t, t->ack, sizeof(t->ack));
+    } else {
+        log_msg(t, "Numéro de bloc incorrect, attendu %d, reçu %d", t->expected_block, block_num);
+    }
+}
+
+// Échéance de retransmission (put) : le RTO depuis timer_start, sans
+// dépasser TFTP_RETRY_BUDGET_MS depuis le dernier ACK nouveau
+static void arm_retransmit(TFTP_Transfer *t) {
+    double deadline = t->timer_start + t->stats.cc.rto_ms;
+    double budget = t->progress_ms + TFTP_RETRY_BUDGET_MS;
+    t->deadline_ms = deadline < budget ? deadline : budget;
+}
+
+// Envoi des blocs de la fenêtre (put), piloté par le contrôle de congestion.
+// Le serveur acquitte chaque bloc reçu dans l'ordre et répète son dernier ACK
+// pour un bloc hors séquence (qu'il garde s'il est dans la fenêtre) ; après
+// un timeout tout repart de base (go-back-N).
+static void send_data_packets(TFTP_Transfer *t) {
+    TFTP_CongestionControl *cc = &t->stats.cc;
+
+    while (t->status == LIBTFTP_RUNNING && t->next < t->base + (uint32_t)cc_window(cc)
+           && (t->last_seq == 0 || t->next <= t->last_seq)) {
+        int slot = t->next % CC_MAX_WINDOW;
+        uint8_t *block = t->blocks[slot];
+
+        if (t->next > t->read_upto) {
+            ssize_t bytes_read = read_block(t, block + 4);
+            if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                // Rien à lire pour l'instant : les blocs déjà lus restent en vol
+                t->source_blocked = 1;
+                break;
+            }
+            t->source_blocked = 0;
+            if (bytes_read < 0) {
+                int err = errno;
+                send_error(t, 0, "Erreur lors de la lecture du fichier");
+                fail(t, TFTP_ERR_SYSTEM, err, "Erreur lors de la lecture du fichier : %s", strerror(err));
+                return;
+            }
+            *(uint16_t*)block = htons(TFTP_OPCODE_DATA);
+            *(uint16_t*)(block + 2) = htons((uint16_t)t->next);
+            t->block_len[slot] = bytes_read + 4;
+            t->retransmitted[slot] = 0;
+            t->read_upto = t->next;
+            if (bytes_read < TFTP_BLOCK_SIZE) {
+                t->last_seq = t->next;
+            }
+        } else {
+            t->retransmitted[slot] = 1;
+            cc->retransmits++;
+        }
+
+        send_packet(t, block, t->block_len[slot]);
+        t->sent_at[slot] = now_ms(t);
+        if (t->next == t->base) {
+            t->timer_start = t->sent_at[slot];
+        }
+        cc->blocks_sent++;
+        log_msg(t, "Paquet DATA [%d] envoyé.", (uint16_t)t->next);
+        t->next++;
+    }
+    arm_retransmit(t);
+}
+
+// Retransmission du seul bloc base (retransmission rapide, ACK partiel)
+static void resend_base(TFTP_Transfer *t) {
+    TFTP_CongestionControl *cc = &t->stats.cc;
+    int slot = t->base % CC_MAX_WINDOW;
+
+    t->retransmitted[slot] = 1;
+    cc->retransmits++;
+    cc->blocks_sent++;
+    send_packet(t, t->blocks[slot], t->block_len[slot]);
+    t->sent_at[slot] = now_ms(t);
+    t->timer_start = t->sent_at[slot];
+    arm_retransmit(t);
+    log_msg(t, "Paquet DATA [%d] envoyé.", (uint16_t)t->base);
+}
+
+// Réception d'un ACK pendant l'envoi (put)
+static void receive_ack(TFTP_Transfer *t, uint16_t ack) {
+    TFTP_CongestionControl *cc = &t->stats.cc;
+    uint32_t delta = (uint16_t)(ack - (uint16_t)(t->base - 1));
+
+    // Après un timeout, next est revenu à base : un ACK reste valable jusqu'au
+    // dernier bloc déjà envoyé
+    if (delta > t->read_upto + 1 - t->base) {
+        // ACK d'un bloc non envoyé ou trop ancien
+        return;
+    }
+
+    if (delta == 0) {
+        if (t->read_upto < t->base) {
+            // Aucun bloc en vol (source en attente) : rien à retransmettre
+            return;
+        }
+        if (t->backed_off && cc->max_window > 1) {
+            // ACK répété par le serveur après un timeout : le chemin répond,
+            // base est renvoyé sans attendre la fin du backoff
+            log_msg(t, "ACK [%d] répété par le serveur, retransmission du paquet DATA [%d].", ack, (uint16_t)t->base);
+            cc->total_dup_acks++;
+            resend_base(t);
+            return;
+        }
+        // ACK dupliqué du dernier bloc acquitté : signe de perte
+        if (cc_on_dup_ack(cc, t->base <= t->recover)) {
+            log_msg(t, "ACK [%d] dupliqué, retransmission rapide du paquet DATA [%d].", ack, (uint16_t)t->base);
+            t->recover = t->next - 1;
+            t->fast_recovery = 1;
+            resend_base(t);
+        }
+        return;
+    }
+
+    uint32_t acked = t->base - 1 + delta;
+    log_msg(t, "ACK [%d] reçu.", ack);
+    int slot = acked % CC_MAX_WINDOW;
+    if (!t->retransmitted[slot]) {
+        cc_on_rtt_sample(cc, now_ms(t) - t->sent_at[slot]);
+    }
+    for (uint32_t seq = t->base; seq <= acked; seq++) {
+        t->stats.bytes += t->block_len[seq % CC_MAX_WINDOW] - 4;
+    }
+    t->stats.blocks += delta;
+    cc_on_ack(cc, delta);
+    t->base = acked + 1;
+    if (t->next < t->base) {
+        t->next = t->base;
+    }
+    t->retryCount = 0;
+    t->backed_off = 0;
+    t->timer_start = now_ms(t);
+    t->progress_ms = t->timer_start;
+    arm_retransmit(t);
+    if (t->fast_recovery) {
+        // ACK partiel (NewReno, RFC 6582) : le bloc suivant manque aussi
+        if (t->base > t->recover) {
+            t->fast_recovery = 0;
+        } else {
+            resend_base(t);
+        }
+    }
+    progress(t);
+
+    if (t->last_seq != 0 && t->base > t->last_seq) {
+        log_msg(t, "Fin de la transmission.");
+        finish(t, LIBTFTP_DONE);
+    }
+}
+
+// OACK en réponse au WRQ : seule l'option windowsize a été demandée, et la
+// valeur acceptée ne peut pas dépasser celle demandée. Retourne -1 sinon.
+static int parse_oack(TFTP_Transfer *t, const uint8_t *buffer, size_t len) {
+    const char *pos = (const char *)buffer + 2, *end = (const char *)buffer + len;
+    while (pos < end) {
+        const char *name_end = memchr(pos, '\0', end - pos);
+        if (name_end == NULL || name_end + 1 >= end) {
+            return -1;
+        }
+        const char *value = name_end + 1;
+        const char *value_end = memchr(value, '\0', end - value);
+        if (value_end == NULL || strcasecmp(pos, "windowsize") != 0) {
+            return -1;
+        }
+        char *end_value;
+        long window = strtol(value, &end_value, 10);
+        if (end_value == value || *end_value != '\0' || window < 1 || window > CC_MAX_WINDOW) {
+            return -1;
+        }
+        t->stats.cc.max_window = (unsigned)window;
+        pos = value_end + 1;
+    }
+    return 0;
+}
+
+// WRQ accepté (ACK 0 ou OACK) : le délai de la réponse sert de première mesure du RTT
+static void write_accepted(TFTP_Transfer *t, const struct sockaddr_in *from) {
+    t->peer = *from;
+    t->connected = 1;
+    if (t->retryCount == 0) {
+        cc_on_rtt_sample(&t->stats.cc, now_ms(t) - t->start_ms);
+    }
+    t->retryCount = 0;
+    t->progress_ms = now_ms(t);
+    t->timer_start = t->progress_ms;
+}
+
+static void handle_packet(TFTP_Transfer *t, const uint8_t *buffer, size_t recvlen, const struct sockaddr_in *from) {
+    if (recvlen < 2 || (recvlen < 4 && ntohs(*(uint16_t*)buffer) != TFTP_OPCODE_OACK)) {
+        return;
+    }
+
+    if (t->connected && (from->sin_port != t->peer.sin_port || from->sin_addr.s_addr != t->peer.sin_addr.s_addr)) {
+        log_msg(t, "Paquet ignoré d'un TID inconnu (port %d)", ntohs(from->sin_port));
+        return;
+    }
+
+    uint16_t opcode = ntohs(*(uint16_t*)buffer);
+
+    if (opcode == TFTP_OPCODE_ERR) {
+        // Paquet d'erreur, texte gardé tel quel pour tftp_transfer_remote_error()
+        char *message = t->remote_message;
+        size_t msg_len = recvlen - 4 < sizeof(t->remote_message) - 1 ? recvlen - 4 : sizeof(t->remote_message) - 1;
+        memcpy(message, buffer + 4, msg_len);
+        message[msg_len] = '\0';
+        fail(t, TFTP_ERR_REMOTE, ntohs(*(uint16_t*)(buffer + 2)),
+             "Paquet ERROR reçu - Code d'erreur: %d, Message: %s", ntohs(*(uint16_t*)(buffer + 2)), message);
+        return;
+    }
+
+    if (t->options.direction == TFTP_GET && opcode == TFTP_OPCODE_DATA) {
+        if (!t->connected) {
+            t->peer = *from;
+            t->connected = 1;
+        }
+        receive_data_packet(t, buffer, recvlen);
+    } else if (t->options.direction == TFTP_PUT && opcode == TFTP_OPCODE_ACK) {
+        uint16_t block_num = ntohs(*(uint16_t*)(buffer + 2));
+        if (!t->connected) {
+            if (block_num != 0) {
+                fail(t, TFTP_ERR_PROTOCOL, 0, "Réponse inattendue du serveur. Attendu : ACK du bloc 0, Reçu : ACK du bloc %d.", block_num);
+                return;
+            }
+            log_msg(t, "ACK[%d] reçu en réponse à la demande d'écriture, serveur sans option windowsize.", block_num);
+            write_accepted(t, from);
+            return;
+        }
+        receive_ack(t, block_num);
+    } else if (t->options.direction == TFTP_PUT && opcode == TFTP_OPCODE_OACK) {
+        if (t->connected) {
+            // OACK répété : équivaut à un ACK 0 dupliqué
+            receive_ack(t, 0);
+            return;
+        }
+        if (parse_oack(t, buffer, recvlen) == -1) {
+            t->peer = *from;
+            send_error(t, 8, "Option refusée");
+            fail(t, TFTP_ERR_PROTOCOL, 0, "OACK invalide reçu du serveur.");
+            return;
+        }
+        log_msg(t, "OACK reçu en réponse à la demande d'écriture, fenêtre de %u blocs.", t->stats.cc.max_window);
+        write_accepted(t, from);
+    } else if (!t->connected) {
+        fail(t, TFTP_ERR_PROTOCOL, 0, "Réponse inattendue du serveur.");
+    } else {
+        // Paquet inattendu, ignorer et continuer à attendre
+        log_msg(t, "Paquet inattendu reçu (opcode %d)", opcode);
+    }
+}
+
+static void handle_timeout(TFTP_Transfer *t) {
+    if (t->options.direction == TFTP_PUT && t->connected) {
+        // Retransmissions au rythme du RTO (backoff exponentiel), abandon
+        // après TFTP_RETRY_BUDGET_MS sans ACK nouveau
+        if (now_ms(t) - t->progress_ms >= TFTP_RETRY_BUDGET_MS) {
+            fail(t, TFTP_ERR_TIMEOUT, 0, "Nombre maximum de tentatives atteint, abandon de la transmission.");
+            return;
+        }
+        if (t->read_upto < t->base) {
+            // Aucun bloc en vol : la source n'a pas encore de données, ce
+            // n'est pas une perte ; le serveur abandonne lui aussi au-delà
+            t->deadline_ms = t->progress_ms + TFTP_RETRY_BUDGET_MS;
+            return;
+        }
+        // Retour à une fenêtre de 1 et retransmission depuis base
+        log_msg(t, "Timeout, retransmission du paquet DATA [%d].", (uint16_t)t->base);
+        cc_on_timeout(&t->stats.cc);
+        t->recover = t->next - 1;
+        t->fast_recovery = 0;
+        t->backed_off = 1;
+        t->next = t->base;
+        t->timer_start = now_ms(t);
+        arm_retransmit(t);
+        return;
+    }
+
+    if (t->retryCount >= TFTP_MAX_RETRIES) {
+        fail(t, TFTP_ERR_TIMEOUT, 0, "Nombre maximum de tentatives atteint, abandon de la transmission.");
+        return;
+    }
+    t->retryCount++;
+
+    if (!t->connected) {
+        // Retransmission de la demande
+        log_msg(t, "Timeout, retransmission de la demande %s.", t->options.direction == TFTP_GET ? "de lecture" : "d'écriture");
+        send_packet(t, t->request, t->request_length);
+        t->deadline_ms = now_ms(t) + TFTP_TIMEOUT_SECONDS * 1000.0;
+    } else {
+        log_msg(t, "Timeout, retransmission de l'ACK précédent");
+        send_packet(t, t->ack, sizeof(t->ack));
+        t->deadline_ms = now_ms(t) + TFTP_TIMEOUT_SECONDS * 1000.0;
+    }
+}
+
+TFTP_Transfer *tftp_transfer_new(const TFTP_Options *options) {
+    TFTP_Transfer *t = calloc(1, sizeof(TFTP_Transfer));
+    if (t == NULL) {
+        return NULL;
+    }
+    t->options = *options;
+    t->sockfd = -1;
+    t->remote_filename = strdup(options->remote_filename);
+    t->transfer_mode = strdup(options->transfer_mode ? options->transfer_mode : "octet");
+    t->options.remote_filename = t->remote_filename;
+    t->options.transfer_mode = t->transfer_mode;
+    if (t->remote_filename == NULL || t->transfer_mode == NULL) {
+        tftp_transfer_free(t);
+        return NULL;
+    }
+
+    if (options->direction == TFTP_PUT) {
+        t->blocks = malloc(CC_MAX_WINDOW * sizeof(*t->blocks));
+        if (t->blocks == NULL) {
+            tftp_transfer_free(t);
+            return NULL;
+        }
+    } else if (options->write_buffer_size >= TFTP_BLOCK_SIZE) {
+        t->write_buffer = malloc(options->write_buffer_size);
+        if (t->write_buffer == NULL) {
+            tftp_transfer_free(t);
+            return NULL;
+        }
+    }
+
+    uint16_t opcode = options->direction == TFTP_GET ? TFTP_OPCODE_RRQ : TFTP_OPCODE_WRQ;
+    t->request_length = build_request(t->request, opcode, t->remote_filename, t->transfer_mode);
+    if (t->request_length != 0 && opcode == TFTP_OPCODE_WRQ) {
+        // Demande d'une fenêtre d'émission (RFC 7440) ; un serveur qui ne
+        // connaît pas l'option répond par un ACK 0 et la fenêtre reste à 1
+        char option[32];
+        int option_length = snprintf(option, sizeof(option), "windowsize%c%d", '\0', CC_MAX_WINDOW) + 1;
+        if (t->request_length + option_length <= TFTP_PACKET_SIZE) {
+            memcpy(t->request + t->request_length, option, option_length);
+            t->request_length += option_length;
+        }
+    }
+    if (t->request_length == 0) {
+        tftp_transfer_free(t);
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+
+    // Créer un socket UDP non bloquant (sauf sur un réseau simulé)
+    if (options->send == NULL) {
+        t->sockfd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (t->sockfd == -1) {
+            tftp_transfer_free(t);
+            return NULL;
+        }
+    }
+
+    t->peer = options->server;
+    t->status = LIBTFTP_RUNNING;
+    t->expected_block = 1;
+    t->base = 1;
+    t->next = 1;
+    cc_init(&t->stats.cc);
+    t->start_ms = now_ms(t);
+    t->timer_start = t->start_ms;
+    t->deadline_ms = t->start_ms + TFTP_TIMEOUT_SECONDS * 1000.0;
+
+    // Envoi de la demande au serveur ; un échec n'est signalé que par le
+    // retour NULL, l'appelant n'ayant pas encore le transfert
+    send_packet(t, t->request, t->request_length);
+    if (t->status != LIBTFTP_RUNNING) {
+        int err = t->error_code;
+        tftp_transfer_free(t);
+        errno = err;
+        return NULL;
+    }
+    if (opcode == TFTP_OPCODE_RRQ) {
+        log_msg(t, "[RRQ] Demande de lecture envoyée au port %d.", ntohs(t->peer.sin_port));
+    } else {
+        log_msg(t, "[WRQ] Demande d'écriture envoyée au port %d.", ntohs(t->peer.sin_port));
+    }
+    return t;
+}
+
+void tftp_transfer_free(TFTP_Transfer *t) {
+    if (t == NULL) {
+        return;
+    }
+    if (t->sockfd != -1) {
+        close(t->sockfd);
+    }
+    free(t->blocks);
+    free(t->write_buffer);
+    free(t->remote_filename);
+    free(t->transfer_mode);
+    free(t);
+}
+
+int tftp_transfer_fd(const TFTP_Transfer *t) {
+    return t->sockfd;
+}
+
+int tftp_transfer_source_fd(const TFTP_Transfer *t) {
+    if (t->status != LIBTFTP_RUNNING || !t->source_blocked || t->options.read) {
+        return -1;
+    }
+    return t->options.fd;
+}
+
+// Délai en millisecondes avant la prochaine échéance (pour poll), -1 si terminé
+int tftp_transfer_timeout(const TFTP_Transfer *t) {
+    if (t->status != LIBTFTP_RUNNING) {
+        return -1;
+    }
+    double remaining = t->deadline_ms - now_ms(t);
+    return remaining > 0 ? (int)remaining + 1 : 0;
+}
+
+// Échéances (retransmissions) et envoi de la fenêtre (put)
+static void tick(TFTP_Transfer *t) {
+    if (t->status == LIBTFTP_RUNNING && now_ms(t) >= t->deadline_ms) {
+        handle_timeout(t);
+    }
+
+    if (t->status == LIBTFTP_RUNNING && t->options.direction == TFTP_PUT && t->connected) {
+        send_data_packets(t);
+    }
+}
+
+static void step(TFTP_Transfer *t) {
+    uint8_t buffer[TFTP_PACKET_SIZE];
+
+    // Nombre de paquets traités par appel borné pour rester équitable dans une boucle partagée
+    for (int i = 0; i < 2 * CC_MAX_WINDOW && t->status == LIBTFTP_RUNNING; i++) {
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        ssize_t recvlen = recvfrom(t->sockfd, buffer, sizeof(buffer), 0, (struct sockaddr*)&from, &from_len);
+        if (recvlen == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                fail(t, TFTP_ERR_SYSTEM, errno, "Erreur lors de la réception : %s", strerror(errno));
+            }
+            break;
+        }
+        handle_packet(t, buffer, recvlen, &from);
+    }
+    tick(t);
+}
+
+// Traite les paquets en attente et les échéances ; à appeler quand le fd est
+// lisible ou que le délai de tftp_transfer_timeout() est écoulé
+int tftp_transfer_step(TFTP_Transfer *t) {
+    step(t);
+    return report(t);
+}
+
+// Réseau simulé : traitement d'un paquet reçu, sans lecture sur un socket
+int tftp_transfer_input(TFTP_Transfer *t, const void *packet, size_t len, const struct sockaddr_in *from) {
+    if (t->status == LIBTFTP_RUNNING) {
+        handle_packet(t, packet, len, from);
+    }
+    return report(t);
+}
+
+int tftp_transfer_tick(TFTP_Transfer *t) {
+    tick(t);
+    return report(t);
+}
+
+// Boucle bloquante jusqu'à la fin du transfert
+int tftp_transfer_run(TFTP_Transfer *t) {
+    while (t->status == LIBTFTP_RUNNING) {
+        // Le descripteur de la source n'est surveillé que si elle a répondu EAGAIN (-1 ignoré par poll)
+        struct pollfd pfd[2] = {
+            { .fd = t->sockfd, .events = POLLIN, .revents = 0 },
+            { .fd = tftp_transfer_source_fd(t), .events = POLLIN, .revents = 0 },
+        };
+        if (poll(pfd, 2, tftp_transfer_timeout(t)) == -1 && errno != EINTR) {
+            fail(t, TFTP_ERR_SYSTEM, errno, "Erreur lors de l'attente : %s", strerror(errno));
+            break;
+        }
+        step(t);
+    }
+    return report(t);
+}
+
+int tftp_transfer_status(const TFTP_Transfer *t) {
+    return t->status;
+}
+
+TFTP_Error tftp_transfer_error(const TFTP_Transfer *t, int *code, const char **message) {
+    if (code) {
+        *code = t->error_code;
+    }
+    if (message) {
+        *message = t->error_message;
+    }
+    return t->error;
+}
+
+int tftp_transfer_remote_error(const TFTP_Transfer *t, const char **message) {
+    if (t->error != TFTP_ERR_REMOTE) {
+        return -1;
+    }
+    if (message) {
+        *message = t->remote_message;
+    }
+    return t->error_code;
+}
+
+const TFTP_Stats *tftp_transfer_stats(const TFTP_Transfer *t) {
+    return &t->stats;
+}
@@ -0,0 +1,121 @@
+#ifndef LIBTFTP_H
+#define LIBTFTP_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+
+// Bibliothèque cliente TFTP non bloquante.
+//
+// Utilisation typique dans une boucle d'événements :
+//   TFTP_Transfer *t = tftp_transfer_new(&options);
+//   poll() sur tftp_transfer_fd(t) (et tftp_transfer_source_fd(t) s'il est
+//   >= 0) avec le délai tftp_transfer_timeout(t)
+//   tftp_transfer_step(t) à chaque réveil, jusqu'à LIBTFTP_DONE ou LIBTFTP_FAILED
+//   tftp_transfer_free(t);
+// tftp_transfer_run() fait cette boucle de manière bloquante.
+//
+// Sur un réseau simulé (options.send et options.clock), il n'y a pas de
+// socket : les paquets reçus sont passés à tftp_transfer_input(), puis
+// tftp_transfer_tick() traite les échéances et envoie la fenêtre.
+
+// Taille des données d'un bloc : un bloc plus court termine le transfert
+#define LIBTFTP_BLOCK_SIZE 512
+
+// États retournés par tftp_transfer_step()
+#define LIBTFTP_RUNNING 0
+#define LIBTFTP_DONE 1
+#define LIBTFTP_FAILED -1
+
+typedef enum {
+    TFTP_GET,
+    TFTP_PUT
+} TFTP_Direction;
+
+typedef enum {
+    TFTP_ERR_NONE = 0,
+    TFTP_ERR_SYSTEM,   // appel système en échec, code = errno
+    TFTP_ERR_TIMEOUT,  // nombre maximum de tentatives atteint
+    TFTP_ERR_REMOTE,   // paquet ERROR reçu du pair, code = code TFTP (voir tftp_transfer_remote_error)
+    TFTP_ERR_PROTOCOL  // paquet inattendu
+} TFTP_Error;
+
+typedef struct {
+    double cwnd;
+    double ssthresh;
+    double max_cwnd;
+    unsigned max_window;  // fenêtre acceptée par le serveur (windowsize), 1 sans l'option
+    unsigned dup_acks;
+    double srtt_ms, rttvar_ms, rto_ms;
+    unsigned long blocks_sent, retransmits, total_dup_acks, fast_retransmits, timeouts;
+} TFTP_CongestionControl;
+
+typedef struct {
+    size_t bytes;         // octets écrits (get) ou acquittés par le serveur (put)
+    unsigned long blocks; // blocs reçus (get) ou acquittés (put)
+    double elapsed_ms;
+    TFTP_CongestionControl cc;
+} TFTP_Stats;
+
+typedef struct TFTP_Transfer TFTP_Transfer;
+
+typedef struct {
+    TFTP_Direction direction;
+    struct sockaddr_in server;
+    const char *remote_filename;
+    const char *transfer_mode; // "octet" ou "netascii"
+
+    // Source (put) ou destination (get) des données. Sans callbacks, fd est utilisé.
+    // Les callbacks ne doivent pas bloquer : ils sont appelés depuis la boucle
+    // d'événements. Une source sans données pour l'instant (read, ou fd en
+    // O_NONBLOCK) retourne -1 avec errno EAGAIN : l'envoi s'arrête aux blocs
+    // déjà lus et reprend au prochain tftp_transfer_step() ou tick(), à
+    // appeler quand la source a des données (voir tftp_transfer_source_fd).
+    int fd;
+    ssize_t (*read)(void *io, void *buf, size_t len);
+    ssize_t (*write)(void *io, const void *buf, size_t len);
+    void *io;
+    // get : taille du tampon regroupant les écritures (0 = une écriture par bloc).
+    // Le tampon est vidé avant l'ACK du dernier bloc.
+    size_t write_buffer_size;
+
+    // Callbacks optionnels. on_complete est appelé une fois, en dernier, par
+    // la fonction (step, input, tick ou run) qui termine le transfert : il
+    // peut le libérer, cette fonction retourne alors sans plus y toucher.
+    void (*on_progress)(TFTP_Transfer *t, const TFTP_Stats *stats, void *user);
+    void (*on_complete)(TFTP_Transfer *t, int status, void *user);
+    void (*on_log)(TFTP_Transfer *t, const char *message, void *user);
+    void *user;
+
+    // Réseau et horloge simulés (optionnels) : envoi des paquets au lieu de
+    // sendto(), et horloge en ms au lieu de CLOCK_MONOTONIC
+    ssize_t (*send)(void *net, const void *packet, size_t len, const struct sockaddr_in *to);
+    double (*clock)(void *net);
+    void *net;
+} TFTP_Options;
+
+// NULL avec errno si le transfert ne peut pas démarrer (on_complete n'est pas appelé)
+TFTP_Transfer *tftp_transfer_new(const TFTP_Options *options);
+void tftp_transfer_free(TFTP_Transfer *t);
+
+int tftp_transfer_fd(const TFTP_Transfer *t);
+// put : fd de la source à surveiller (POLLIN) quand sa dernière lecture a
+// répondu EAGAIN, sinon -1 (toujours -1 avec un callback read)
+int tftp_transfer_source_fd(const TFTP_Transfer *t);
+int tftp_transfer_timeout(const TFTP_Transfer *t);
+int tftp_transfer_step(TFTP_Transfer *t);
+int tftp_transfer_run(TFTP_Transfer *t);
+int tftp_transfer_input(TFTP_Transfer *t, const void *packet, size_t len, const struct sockaddr_in *from);
+int tftp_transfer_tick(TFTP_Transfer *t);
+
+int tftp_transfer_status(const TFTP_Transfer *t);
+// Cause de l'échec ; code selon l'erreur, message formaté pour l'affichage
+TFTP_Error tftp_transfer_error(const TFTP_Transfer *t, int *code, const char **message);
+// Code et texte brut du paquet ERROR reçu du pair, -1 si l'échec a une autre cause
+int tftp_transfer_remote_error(const TFTP_Transfer *t, const char **message);
+const TFTP_Stats *tftp_transfer_stats(const TFTP_Transfer *t);
+
+void tftp_print_stats(FILE *out, const TFTP_Stats *stats);
+
+#endif
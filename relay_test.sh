@@ -0,0 +1,86 @@
+#!/bin/sh
+# Test du mode relais avec deux instances du serveur sur la boucle locale :
+# un serveur amont qui sert un répertoire, et un relais (-U) qui sert un
+# autre répertoire et télécharge les fichiers absents depuis l'amont.
+#
+# Vérifie : premier téléchargement via le relais, lecture depuis le cache,
+# demandes simultanées d'un même fichier, erreur de l'amont transmise telle
+# quelle, et refus des chemins du cache (fichiers partiels ou non).
+#
+# Usage : ./relay_test.sh [port amont (défaut 16969)] [port relais (défaut 16970)]
+
+UPSTREAM_PORT=${1:-16969}
+RELAY_PORT=${2:-16970}
+BIN=$(cd "$(dirname "$0")" && pwd)
+WORK=$(mktemp -d)
+FAILED=0
+
+cleanup() {
+    [ -n "$UPSTREAM_PID" ] && kill "$UPSTREAM_PID" 2>/dev/null
+    [ -n "$RELAY_PID" ] && kill "$RELAY_PID" 2>/dev/null
+    wait 2>/dev/null
+    rm -rf "$WORK"
+}
+trap cleanup EXIT INT TERM
+
+check() {
+    if [ "$1" -eq 0 ]; then
+        echo "[OK] $2"
+    else
+        echo "[ECHEC] $2"
+        FAILED=1
+    fi
+}
+
+# Téléchargement via le relais ; $1 nom demandé, $2 fichier local
+get() {
+    "$BIN/tftp_client" 127.0.0.1 "$RELAY_PORT" get "$1" octet "$2" > "$2.log" 2>&1
+}
+
+mkdir -p "$WORK/upstream" "$WORK/relay" "$WORK/client"
+head -c 300000 /dev/urandom > "$WORK/upstream/a.bin"
+head -c 2000000 /dev/urandom > "$WORK/upstream/b.bin"
+mkdir -p "$WORK/upstream/sub"
+head -c 5000 /dev/urandom > "$WORK/upstream/sub/c.bin"
+
+(cd "$WORK/upstream" && exec "$BIN/tftp_server" -p "$UPSTREAM_PORT" > "$WORK/upstream.log" 2>&1) &
+UPSTREAM_PID=$!
+(cd "$WORK/relay" && exec "$BIN/tftp_server" -p "$RELAY_PORT" -U "127.0.0.1:$UPSTREAM_PORT" > "$WORK/relay.log" 2>&1) &
+RELAY_PID=$!
+sleep 0.5
+
+cd "$WORK/client" || exit 1
+
+get a.bin a1 && cmp -s a1 ../upstream/a.bin
+check $? "premier téléchargement via le relais"
+
+get a.bin a2 && cmp -s a2 ../upstream/a.bin && grep -q "a.bin en cache" ../relay.log
+check $? "second téléchargement depuis le cache"
+
+get sub/c.bin c1 && cmp -s c1 ../upstream/sub/c.bin
+check $? "fichier dans un sous-répertoire"
+
+# Trois clients pendant le téléchargement : un seul RRQ vers l'amont
+get b.bin b1 & P1=$!
+get b.bin b2 & P2=$!
+get b.bin b3 & P3=$!
+wait $P1 && wait $P2 && wait $P3 &&
+    cmp -s b1 ../upstream/b.bin && cmp -s b2 ../upstream/b.bin && cmp -s b3 ../upstream/b.bin &&
+    [ "$(grep -c 'file: b.bin' ../upstream.log)" -eq 1 ]
+check $? "demandes simultanées partageant le téléchargement"
+
+! get absent.bin x && grep -q "Code d'erreur: 1, Message: Fichier non trouvé" x.log
+check $? "erreur de l'amont transmise au client"
+
+! get .relay-cache/a.bin y1 && grep -q "Accès refusé" y1.log &&
+    ! get ./.relay-cache/../.relay-cache/sub/c.bin y2 && grep -q "Accès refusé" y2.log &&
+    ! get "$WORK/relay/.relay-cache/a.bin" y3 && grep -q "Accès refusé" y3.log
+check $? "fichiers du cache inaccessibles directement"
+
+if [ $FAILED -ne 0 ]; then
+    echo "Journaux : relais"
+    cat ../relay.log
+    echo "Journaux : amont"
+    cat ../upstream.log
+fi
+exit $FAILED
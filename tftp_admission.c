@@ -0,0 +1,243 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+
+#include "tftp_admission.h"
+
+// File d'attente des requêtes quand le nombre de sessions est au maximum.
+// Tas binaire ordonné par une clé fixée à l'arrivée : heure d'arrivée plus
+// le temps de transfert du fichier au débit de vieillissement, borné à
+// ADMISSION_MAX_SIZE_DELAY_MS. Les petits fichiers passent devant, mais une
+// requête n'est jamais doublée par celles arrivées plus de ce délai après
+// elle, quelle que soit sa taille.
+//
+// Un index (adressage ouvert, sondage linéaire) retrouve en O(1) une requête
+// retransmise par un client en attente ; il contient la position de chaque
+// requête dans le tas, tenue à jour à chaque échange.
+
+#define EMPTY_SLOT ((size_t)-1)
+
+// Position de la requête dans l'index et empreinte de (client, requête, fichier)
+typedef struct {
+    size_t slot;
+    uint64_t hash;
+} TFTP_PendingLink;
+
+static TFTP_Pending *heap;
+static TFTP_PendingLink *links;
+static size_t heap_size, heap_capacity;
+static size_t *index_slots;   // position dans le tas, EMPTY_SLOT si libre
+static size_t index_mask;
+static double aging_bytes_per_ms = ADMISSION_DEFAULT_AGING_RATE * 1048.576;
+
+int admission_init(size_t max_pending, unsigned aging_rate) {
+    if (aging_rate == 0) {
+        return -1;
+    }
+    // La file n'est allouée qu'à la première mise en attente
+    free(heap);
+    free(links);
+    free(index_slots);
+    heap = NULL;
+    links = NULL;
+    index_slots = NULL;
+    heap_size = 0;
+    heap_capacity = max_pending;
+    aging_bytes_per_ms = aging_rate * 1048.576;
+    return 0;
+}
+
+// FNV-1a sur l'adresse, le port, l'opcode et le nom de fichier
+static uint64_t request_hash(const struct sockaddr_in *client_addr, const TFTP_Request *request) {
+    uint64_t h = 14695981039346656037ULL;
+    unsigned char key[8];
+    memcpy(key, &client_addr->sin_addr.s_addr, 4);
+    memcpy(key + 4, &client_addr->sin_port, 2);
+    memcpy(key + 6, &request->opcode, 2);
+    for (size_t i = 0; i < sizeof(key); i++) {
+        h = (h ^ key[i]) * 1099511628211ULL;
+    }
+    for (const char *c = request->filename; *c != '\0'; c++) {
+        h = (h ^ (unsigned char)*c) * 1099511628211ULL;
+    }
+    return h;
+}
+
+static int same_request(const TFTP_Pending *p, const struct sockaddr_in *client_addr, const TFTP_Request *request) {
+    return p->client_addr.sin_addr.s_addr == client_addr->sin_addr.s_addr &&
+           p->client_addr.sin_port == client_addr->sin_port &&
+           p->request.opcode == request->opcode &&
+           strcmp(p->request.filename, request->filename) == 0;
+}
+
+static int allocate(void) {
+    // Index au plus à moitié plein : sondages courts
+    size_t index_capacity = 2;
+    while (index_capacity < 2 * heap_capacity) {
+        index_capacity *= 2;
+    }
+    heap = malloc(heap_capacity * sizeof(TFTP_Pending));
+    links = malloc(heap_capacity * sizeof(TFTP_PendingLink));
+    index_slots = malloc(index_capacity * sizeof(size_t));
+    if (heap == NULL || links == NULL || index_slots == NULL) {
+        free(heap);
+        free(links);
+        free(index_slots);
+        heap = NULL;
+        links = NULL;
+        index_slots = NULL;
+        return -1;
+    }
+    for (size_t i = 0; i < index_capacity; i++) {
+        index_slots[i] = EMPTY_SLOT;
+    }
+    index_mask = index_capacity - 1;
+    return 0;
+}
+
+static void index_insert(size_t pos) {
+    size_t slot = links[pos].hash & index_mask;
+    while (index_slots[slot] != EMPTY_SLOT) {
+        slot = (slot + 1) & index_mask;
+    }
+    index_slots[slot] = pos;
+    links[pos].slot = slot;
+}
+
+// Suppression par décalage arrière : les entrées suivantes du même groupe
+// reviennent combler le trou, sans marqueur de suppression
+static void index_remove(size_t pos) {
+    size_t hole = links[pos].slot;
+    size_t slot = hole;
+    while (1) {
+        slot = (slot + 1) & index_mask;
+        if (index_slots[slot] == EMPTY_SLOT) {
+            break;
+        }
+        size_t home = links[index_slots[slot]].hash & index_mask;
+        // L'entrée peut reculer si le trou est entre sa place idéale et elle
+        if (((slot - home) & index_mask) >= ((slot - hole) & index_mask)) {
+            index_slots[hole] = index_slots[slot];
+            links[index_slots[hole]].slot = hole;
+            hole = slot;
+        }
+    }
+    index_slots[hole] = EMPTY_SLOT;
+}
+
+// Déplacement de la requête de la position from à to dans le tas
+static void move(size_t to, size_t from) {
+    heap[to] = heap[from];
+    links[to] = links[from];
+    index_slots[links[to].slot] = to;
+}
+
+static void swap(size_t i, size_t j) {
+    TFTP_Pending tmp = heap[i];
+    TFTP_PendingLink tmp_link = links[i];
+    move(i, j);
+    heap[j] = tmp;
+    links[j] = tmp_link;
+    index_slots[links[j].slot] = j;
+}
+
+static void sift_up(size_t i) {
+    while (i > 0 && heap[(i - 1) / 2].key > heap[i].key) {
+        swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void sift_down(size_t i) {
+    while (2 * i + 1 < heap_size) {
+        size_t child = 2 * i + 1;
+        if (child + 1 < heap_size && heap[child + 1].key < heap[child].key) {
+            child++;
+        }
+        if (heap[i].key <= heap[child].key) {
+            break;
+        }
+        swap(i, child);
+        i = child;
+    }
+}
+
+// Retrait de la requête à la position pos, remplacée par la dernière du tas
+static void remove_at(size_t pos) {
+    index_remove(pos);
+    if (pos == --heap_size) {
+        return;
+    }
+    move(pos, heap_size);
+    sift_up(pos);
+    sift_down(pos);
+}
+
+int admission_push(const struct sockaddr_in *client_addr, const TFTP_Request *request,
+                   TFTP_CacheEntry *file, off_t size, uint64_t now, TFTP_Pending *evicted) {
+    double size_delay = size / aging_bytes_per_ms;
+    if (size_delay > ADMISSION_MAX_SIZE_DELAY_MS) {
+        size_delay = ADMISSION_MAX_SIZE_DELAY_MS;
+    }
+    uint64_t key = now + (uint64_t)size_delay;
+    int ret = 0;
+
+    if (heap == NULL && heap_capacity > 0 && allocate() == -1) {
+        return -1;
+    }
+
+    if (heap_size == heap_capacity) {
+        // La plus grande clé est dans une feuille
+        size_t worst = heap_size / 2;
+        for (size_t i = worst; i < heap_size; i++) {
+            if (heap[i].key > heap[worst].key) {
+                worst = i;
+            }
+        }
+        if (heap_size == 0 || heap[worst].key <= key) {
+            return -1;
+        }
+        *evicted = heap[worst];
+        remove_at(worst);
+        ret = 1;
+    }
+
+    size_t i = heap_size++;
+    heap[i].key = key;
+    heap[i].arrival = now;
+    heap[i].client_addr = *client_addr;
+    heap[i].file = file;
+    heap[i].request = *request;
+    links[i].hash = request_hash(client_addr, request);
+    index_insert(i);
+    sift_up(i);
+    return ret;
+}
+
+int admission_pop(TFTP_Pending *out) {
+    if (heap_size == 0) {
+        return -1;
+    }
+    *out = heap[0];
+    remove_at(0);
+    return 0;
+}
+
+// Un client qui retransmet sa requête pendant l'attente garde sa place
+int admission_queued(const struct sockaddr_in *client_addr, const TFTP_Request *request) {
+    if (heap_size == 0) {
+        return 0;
+    }
+    uint64_t hash = request_hash(client_addr, request);
+    for (size_t slot = hash & index_mask; index_slots[slot] != EMPTY_SLOT; slot = (slot + 1) & index_mask) {
+        size_t pos = index_slots[slot];
+        if (links[pos].hash == hash && same_request(&heap[pos], client_addr, request)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+size_t admission_count(void) {
+    return heap_size;
+}
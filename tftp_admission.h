@@ -0,0 +1,43 @@
+#ifndef TFTP_ADMISSION_H
+#define TFTP_ADMISSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+
+#include "tftp_packet.h"
+#include "tftp_cache.h"
+
+// Sessions simultanées et requêtes en attente par défaut
+#define ADMISSION_DEFAULT_MAX_SESSIONS 256
+#define ADMISSION_DEFAULT_MAX_PENDING 1024
+// Vieillissement : chaque Mo à transférer retarde une requête d'autant de ms
+// qu'il en faut pour transférer un Mo à ce débit (en Mo/s)
+#define ADMISSION_DEFAULT_AGING_RATE 10
+// Retard maximal dû à la taille : une requête n'attend jamais plus que ce
+// délai derrière une requête arrivée après elle
+#define ADMISSION_MAX_SIZE_DELAY_MS 5000
+// Au-delà, le client a sans doute abandonné : la requête est retirée avec une erreur
+#define ADMISSION_MAX_WAIT_MS 30000
+
+// Requête en attente d'admission
+typedef struct {
+    uint64_t key;              // arrivée + min(taille / débit de vieillissement, ADMISSION_MAX_SIZE_DELAY_MS)
+    uint64_t arrival;
+    struct sockaddr_in client_addr;
+    TFTP_CacheEntry *file;     // RRQ : fichier déjà résolu, NULL pour un WRQ
+    TFTP_Request request;
+} TFTP_Pending;
+
+int admission_init(size_t max_pending, unsigned aging_rate);
+// File pleine : la requête de plus grande clé est évincée (retour 1, copiée
+// dans evicted) si la nouvelle passe avant elle, sinon -1
+int admission_push(const struct sockaddr_in *client_addr, const TFTP_Request *request,
+                   TFTP_CacheEntry *file, off_t size, uint64_t now, TFTP_Pending *evicted);
+// Requête la plus prioritaire ; -1 si la file est vide
+int admission_pop(TFTP_Pending *out);
+// Même client (adresse et port), même requête et même fichier déjà en attente
+int admission_queued(const struct sockaddr_in *client_addr, const TFTP_Request *request);
+size_t admission_count(void);
+
+#endif
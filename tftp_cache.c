@@ -0,0 +1,645 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+
+#include "tftp_cache.h"
+
+// Cache de résolution des chemins servis (entrées positives et négatives).
+// Les entrées sont invalidées par inotify : chaque répertoire existant sur le
+// chemin d'une entrée est surveillé, du répertoire de départ au parent. Un
+// événement sur un nom supprime l'entrée de ce nom et, pour un répertoire
+// (renommé, supprimé, créé), toutes les entrées en dessous ; un fichier
+// demandé dans un répertoire absent est donc mis en cache négatif jusqu'à la
+// création de ce répertoire. Une surveillance est retirée avec la dernière
+// entrée qui l'utilise. Une entrée dont un répertoire ne peut pas être
+// surveillé n'est jamais mise en cache.
+//
+// Une recherche absente du cache ne bloque pas la boucle d'événements : les
+// surveillances sont posées tout de suite, puis l'ouverture et le fstat()
+// partent dans un groupe de threads. La fin est signalée par un eventfd
+// (cache_resolver_fd) et cache_process() appelle done(owner, entry) pour
+// chaque requête en attente de ce chemin. Un événement inotify sur le chemin
+// pendant la résolution rend le résultat transitoire : il est transmis mais
+// pas mis en cache.
+
+#define CACHE_BUCKETS 8192 // puissance de 2, >= CACHE_MAX_ENTRIES
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | \
+                    IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+typedef struct {
+    int wd;
+    int refs;     // entrées en cache qui dépendent de ce répertoire
+    char *prefix; // "" pour le répertoire courant, sinon "dir/"
+} TFTP_Watch;
+
+static int inotify_fd = -1;
+static TFTP_CacheEntry *buckets[CACHE_BUCKETS];
+static TFTP_CacheEntry *lru_head, *lru_tail;
+static size_t num_entries, num_open_fds;
+
+static TFTP_Watch *watches;
+static size_t num_watches, watches_capacity;
+
+// Résolution en cours d'un chemin absent du cache
+typedef struct TFTP_Resolution {
+    TFTP_CacheEntry *entry;  // surveillances posées, fd/err remplis par le thread
+    int stale;               // événement sur le chemin entre-temps : non caché
+    void **owners;           // requêtes qui attendent ce chemin
+    size_t num_owners;
+    struct TFTP_Resolution *next_job;      // file des threads, puis des résolutions terminées
+    struct TFTP_Resolution *next_pending;  // résolutions en cours (boucle seulement)
+} TFTP_Resolution;
+
+static TFTP_Resolution *pending;
+static size_t num_pending;
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    TFTP_Resolution *queue_head, *queue_tail;
+    TFTP_Resolution *done_head;
+    int started;
+    int event_fd;
+    void (*done)(void *owner, TFTP_CacheEntry *entry);
+} pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .work = PTHREAD_COND_INITIALIZER,
+    .event_fd = -1,
+};
+
+static uint32_t hash_path(const char *path) {
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (; *path; path++) {
+        h ^= (unsigned char)*path;
+        h *= 16777619u;
+    }
+    return h & (CACHE_BUCKETS - 1);
+}
+
+// Supprime les composants "." et les '/' redondants. Retourne -1 si le chemin est vide ou trop long.
+static int normalize_path(const char *path, char *out, size_t out_size) {
+    size_t len = 0;
+    const char *p = path;
+
+    if (*p == '/') {
+        out[len++] = '/';
+    }
+    while (*p) {
+        while (*p == '/') p++;
+        const char *start = p;
+        while (*p && *p != '/') p++;
+        size_t comp_len = p - start;
+        if (comp_len == 0 || (comp_len == 1 && start[0] == '.')) {
+            continue;
+        }
+        if (len > 0 && out[len - 1] != '/') {
+            out[len++] = '/';
+        }
+        if (len + comp_len + 1 > out_size) {
+            return -1;
+        }
+        memcpy(out + len, start, comp_len);
+        len += comp_len;
+    }
+    out[len] = '\0';
+    return (len == 0 || out[len - 1] == '/') ? -1 : 0;
+}
+
+static TFTP_Watch *find_watch(int wd) {
+    for (size_t i = 0; i < num_watches; i++) {
+        if (watches[i].wd == wd) {
+            return &watches[i];
+        }
+    }
+    return NULL;
+}
+
+// Surveille le répertoire prefix (prefix_len premiers octets de path). Retourne
+// le wd, ou -1 si le répertoire n'existe pas ou ne peut pas être surveillé.
+static int add_watch(const char *path, size_t prefix_len) {
+    char dir[PATH_MAX];
+
+    if (prefix_len == 0) {
+        strcpy(dir, ".");
+    } else {
+        memcpy(dir, path, prefix_len);
+        dir[prefix_len] = '\0';
+    }
+
+    int wd = inotify_add_watch(inotify_fd, dir, WATCH_MASK);
+    if (wd == -1) {
+        return -1;
+    }
+
+    TFTP_Watch *watch = find_watch(wd);
+    if (watch != NULL) {
+        // Le même répertoire atteint par un autre chemin (lien symbolique) : les
+        // événements ne pourraient pas être rapprochés de cette clé
+        if (strlen(watch->prefix) != prefix_len || strncmp(watch->prefix, path, prefix_len) != 0) {
+            errno = ELOOP;
+            return -1;
+        }
+        watch->refs++;
+        return wd;
+    }
+
+    if (num_watches == watches_capacity) {
+        size_t new_capacity = watches_capacity ? watches_capacity * 2 : 16;
+        TFTP_Watch *tmp = realloc(watches, new_capacity * sizeof(TFTP_Watch));
+        if (tmp == NULL) {
+            inotify_rm_watch(inotify_fd, wd);
+            errno = ENOMEM;
+            return -1;
+        }
+        watches = tmp;
+        watches_capacity = new_capacity;
+    }
+    char *prefix = strndup(path, prefix_len);
+    if (prefix == NULL) {
+        inotify_rm_watch(inotify_fd, wd);
+        errno = ENOMEM;
+        return -1;
+    }
+    watches[num_watches].wd = wd;
+    watches[num_watches].refs = 1;
+    watches[num_watches].prefix = prefix;
+    num_watches++;
+    return wd;
+}
+
+// Libère une référence ; la surveillance est retirée avec la dernière
+static void release_watch(int wd) {
+    TFTP_Watch *watch = find_watch(wd);
+    if (watch == NULL || --watch->refs > 0) {
+        return;
+    }
+    // Déjà retirée par le noyau (répertoire supprimé) : EINVAL, sans effet
+    inotify_rm_watch(inotify_fd, wd);
+    free(watch->prefix);
+    *watch = watches[--num_watches];
+}
+
+static void release_watches(TFTP_CacheEntry *entry) {
+    for (size_t i = 0; i < entry->num_wds; i++) {
+        release_watch(entry->wds[i]);
+    }
+    entry->num_wds = 0;
+}
+
+// Surveille chaque répertoire de path, du répertoire de départ au parent,
+// jusqu'au premier absent : sa création sera vue dans le dernier surveillé.
+// Retourne -1 si un répertoire existant ne peut pas être surveillé.
+static int watch_ancestors(TFTP_CacheEntry *entry) {
+    const char *path = entry->path;
+    size_t depth = 1;
+    for (const char *p = path + 1; *p; p++) {
+        depth += *p == '/';
+    }
+    entry->wds = malloc(depth * sizeof(int));
+    if (entry->wds == NULL) {
+        return -1;
+    }
+
+    // Chemin absolu : à partir de "/", sinon du répertoire courant ("")
+    size_t prefix_len = path[0] == '/' ? 1 : 0;
+    while (1) {
+        int wd = add_watch(path, prefix_len);
+        if (wd == -1) {
+            if (errno == ENOENT || errno == ENOTDIR) {
+                return 0;
+            }
+            release_watches(entry);
+            return -1;
+        }
+        entry->wds[entry->num_wds++] = wd;
+
+        const char *slash = strchr(path + prefix_len, '/');
+        if (slash == NULL) {
+            return 0;
+        }
+        prefix_len = (size_t)(slash - path) + 1;
+    }
+}
+
+static void free_entry(TFTP_CacheEntry *entry) {
+    if (entry->fd != -1) {
+        close(entry->fd);
+    }
+    free(entry->wds);
+    free(entry->path);
+    free(entry);
+}
+
+static void lru_unlink(TFTP_CacheEntry *entry) {
+    if (entry->lru_prev) entry->lru_prev->lru_next = entry->lru_next;
+    else lru_head = entry->lru_next;
+    if (entry->lru_next) entry->lru_next->lru_prev = entry->lru_prev;
+    else lru_tail = entry->lru_prev;
+    entry->lru_prev = entry->lru_next = NULL;
+}
+
+static void lru_push_front(TFTP_CacheEntry *entry) {
+    entry->lru_prev = NULL;
+    entry->lru_next = lru_head;
+    if (lru_head) lru_head->lru_prev = entry;
+    lru_head = entry;
+    if (lru_tail == NULL) lru_tail = entry;
+}
+
+// Retire une entrée du cache ; elle est libérée dès qu'elle n'est plus référencée
+static void invalidate(TFTP_CacheEntry *entry) {
+    TFTP_CacheEntry **pp = &buckets[hash_path(entry->path)];
+    while (*pp != entry) {
+        pp = &(*pp)->hash_next;
+    }
+    *pp = entry->hash_next;
+    lru_unlink(entry);
+    num_entries--;
+    if (entry->fd != -1) {
+        num_open_fds--;
+    }
+    release_watches(entry);
+
+    if (entry->refs == 0) {
+        free_entry(entry);
+    } else {
+        entry->dead = 1;
+    }
+}
+
+static TFTP_CacheEntry *find_entry(const char *path) {
+    for (TFTP_CacheEntry *e = buckets[hash_path(path)]; e != NULL; e = e->hash_next) {
+        if (strcmp(e->path, path) == 0) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+// path commence par prefix ("" : tout le répertoire courant, NULL : tout)
+static int path_under(const char *path, const char *prefix) {
+    if (prefix == NULL) {
+        return 1;
+    }
+    return prefix[0] == '\0' ? path[0] != '/' : strncmp(path, prefix, strlen(prefix)) == 0;
+}
+
+// Invalide les entrées sous prefix, et rend transitoires les résolutions en
+// cours de ces chemins
+static void invalidate_prefix(const char *prefix) {
+    TFTP_CacheEntry *e = lru_head;
+    while (e != NULL) {
+        TFTP_CacheEntry *next = e->lru_next;
+        if (path_under(e->path, prefix)) {
+            invalidate(e);
+        }
+        e = next;
+    }
+    for (TFTP_Resolution *r = pending; r != NULL; r = r->next_pending) {
+        if (path_under(r->entry->path, prefix)) {
+            r->stale = 1;
+        }
+    }
+}
+
+int cache_init(void (*done)(void *owner, TFTP_CacheEntry *entry)) {
+    if (pool.event_fd == -1) {
+        pool.event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (pool.event_fd == -1) {
+            return -1;
+        }
+    }
+    pool.done = done;
+    if (inotify_fd == -1) {
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd == -1) {
+            perror("Erreur lors de l'initialisation d'inotify, cache désactivé");
+        }
+    }
+    return 0;
+}
+
+int cache_fd(void) {
+    return inotify_fd;
+}
+
+int cache_resolver_fd(void) {
+    return pool.event_fd;
+}
+
+size_t cache_pending(void) {
+    return num_pending;
+}
+
+static void process_events(void) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    if (inotify_fd == -1) {
+        return;
+    }
+
+    while (1) {
+        ssize_t len = read(inotify_fd, buf, sizeof(buf));
+        if (len <= 0) {
+            // EAGAIN : plus d'événements en attente
+            return;
+        }
+
+        for (char *p = buf; p < buf + len; ) {
+            struct inotify_event *event = (struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                // Des événements ont été perdus : tout le cache est suspect
+                invalidate_prefix(NULL);
+                continue;
+            }
+
+            // Surveillance inconnue : retirée avec sa dernière entrée
+            TFTP_Watch *watch = find_watch(event->wd);
+            if (watch == NULL) {
+                continue;
+            }
+
+            char path[PATH_MAX];
+            if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                // Répertoire supprimé ou déplacé : les entrées en dessous
+                // libèrent la surveillance, qui ne doit donc plus être lue
+                snprintf(path, sizeof(path), "%s", watch->prefix);
+                int wd = event->wd;
+                invalidate_prefix(path);
+                if ((event->mask & IN_IGNORED) && (watch = find_watch(wd)) != NULL) {
+                    free(watch->prefix);
+                    *watch = watches[--num_watches];
+                }
+                continue;
+            }
+
+            if (event->len > 0) {
+                snprintf(path, sizeof(path), "%s%s", watch->prefix, event->name);
+                TFTP_CacheEntry *entry = find_entry(path);
+                if (entry != NULL) {
+                    invalidate(entry);
+                }
+                for (TFTP_Resolution *r = pending; r != NULL; r = r->next_pending) {
+                    if (strcmp(r->entry->path, path) == 0) {
+                        r->stale = 1;
+                    }
+                }
+                if (event->mask & IN_ISDIR) {
+                    // Répertoire renommé, créé ou supprimé : tout ce qui est en dessous
+                    strncat(path, "/", sizeof(path) - strlen(path) - 1);
+                    invalidate_prefix(path);
+                }
+            }
+        }
+    }
+}
+
+// Ouverture du fichier d'une entrée (thread de résolution, ou boucle si les
+// threads n'ont pas pu démarrer)
+static void resolve(TFTP_CacheEntry *entry) {
+    entry->fd = open(entry->path, O_RDONLY | O_CLOEXEC);
+    if (entry->fd == -1) {
+        entry->err = errno;
+        return;
+    }
+    struct stat st;
+    if (fstat(entry->fd, &st) == -1) {
+        entry->err = errno;
+    } else if (!S_ISREG(st.st_mode)) {
+        entry->err = S_ISDIR(st.st_mode) ? EISDIR : EACCES;
+    }
+    if (entry->err != 0) {
+        close(entry->fd);
+        entry->fd = -1;
+    } else {
+        entry->size = st.st_size;
+        entry->mtime = st.st_mtime;
+    }
+}
+
+static void *resolver_thread(void *arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&pool.lock);
+    while (1) {
+        while (pool.queue_head == NULL) {
+            pthread_cond_wait(&pool.work, &pool.lock);
+        }
+        TFTP_Resolution *r = pool.queue_head;
+        pool.queue_head = r->next_job;
+        if (pool.queue_head == NULL) {
+            pool.queue_tail = NULL;
+        }
+        pthread_mutex_unlock(&pool.lock);
+
+        resolve(r->entry);
+
+        pthread_mutex_lock(&pool.lock);
+        r->next_job = pool.done_head;
+        pool.done_head = r;
+        uint64_t one = 1;
+        ssize_t ret = write(pool.event_fd, &one, sizeof(one));
+        (void)ret; // compteur saturé : la boucle a déjà un réveil en attente
+    }
+    return NULL;
+}
+
+// Démarrage des threads à la première recherche absente du cache
+static int start_pool(void) {
+    if (pool.started) {
+        return 0;
+    }
+    for (int i = 0; i < CACHE_THREADS; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, resolver_thread, NULL) != 0) {
+            return i == 0 ? -1 : 0;
+        }
+        pthread_detach(thread);
+    }
+    pool.started = 1;
+    return 0;
+}
+
+// Résultat d'une résolution : mis en cache si ses répertoires sont surveillés
+// et n'ont pas changé entre-temps, sinon transitoire
+static void insert(TFTP_CacheEntry *entry, int cacheable) {
+    if (!cacheable) {
+        release_watches(entry);
+        entry->dead = 1;
+        return;
+    }
+
+    uint32_t h = hash_path(entry->path);
+    entry->hash_next = buckets[h];
+    buckets[h] = entry;
+    lru_push_front(entry);
+    num_entries++;
+    if (entry->fd != -1) {
+        num_open_fds++;
+    }
+
+    // Éviction LRU : d'abord le nombre total d'entrées, puis les fd ouverts
+    while (num_entries > CACHE_MAX_ENTRIES && lru_tail != entry) {
+        invalidate(lru_tail);
+    }
+    for (TFTP_CacheEntry *e = lru_tail; num_open_fds > CACHE_MAX_OPEN_FDS && e != NULL; ) {
+        TFTP_CacheEntry *prev = e->lru_prev;
+        if (e->fd != -1 && e != entry) {
+            invalidate(e);
+        }
+        e = prev;
+    }
+}
+
+void cache_process(void) {
+    uint64_t count;
+    ssize_t ret = read(pool.event_fd, &count, sizeof(count));
+    (void)ret; // EAGAIN : réveil par inotify seulement
+
+    pthread_mutex_lock(&pool.lock);
+    TFTP_Resolution *done = pool.done_head;
+    pool.done_head = NULL;
+    pthread_mutex_unlock(&pool.lock);
+
+    // Les événements signalés avant la fin d'une résolution sont lus avant
+    // sa mise en cache
+    process_events();
+
+    while (done != NULL) {
+        TFTP_Resolution *r = done;
+        done = r->next_job;
+
+        TFTP_Resolution **pp = &pending;
+        while (*pp != r) {
+            pp = &(*pp)->next_pending;
+        }
+        *pp = r->next_pending;
+        num_pending--;
+
+        TFTP_CacheEntry *entry = r->entry;
+        insert(entry, !r->stale && entry->num_wds > 0);
+        // Références prises avant les appels : une entrée transitoire libérée
+        // par le premier ne doit pas disparaître pour les suivants
+        entry->refs += r->num_owners;
+        for (size_t i = 0; i < r->num_owners; i++) {
+            pool.done(r->owners[i], entry);
+        }
+        free(r->owners);
+        free(r);
+    }
+}
+
+TFTP_CacheEntry *cache_lookup(const char *path, void *owner) {
+    char key[PATH_MAX];
+
+    process_events();
+
+    TFTP_CacheEntry *entry = NULL;
+    if (normalize_path(path, key, sizeof(key)) == 0) {
+        entry = find_entry(key);
+    }
+    if (entry != NULL) {
+        lru_unlink(entry);
+        lru_push_front(entry);
+        entry->refs++;
+        return entry;
+    }
+
+    if (normalize_path(path, key, sizeof(key)) == 0) {
+        // Même chemin déjà en cours de résolution : une seule ouverture
+        for (TFTP_Resolution *r = pending; r != NULL; r = r->next_pending) {
+            if (strcmp(r->entry->path, key) == 0) {
+                void **owners = realloc(r->owners, (r->num_owners + 1) * sizeof(void *));
+                if (owners == NULL) {
+                    return NULL;
+                }
+                owners[r->num_owners++] = owner;
+                r->owners = owners;
+                errno = EINPROGRESS;
+                return NULL;
+            }
+        }
+    }
+
+    entry = calloc(1, sizeof(TFTP_CacheEntry));
+    if (entry == NULL) {
+        return NULL;
+    }
+    entry->fd = -1;
+
+    if (normalize_path(path, key, sizeof(key)) == -1) {
+        entry->err = ENOENT;
+        entry->dead = 1;
+        entry->refs = 1;
+        return entry;
+    }
+    entry->path = strdup(key);
+    if (entry->path == NULL) {
+        free(entry);
+        return NULL;
+    }
+
+    // La surveillance est posée avant l'ouverture : une création concurrente
+    // du fichier produira un événement qui invalidera l'entrée négative
+    if (inotify_fd != -1) {
+        watch_ancestors(entry);
+    }
+
+    TFTP_Resolution *r = calloc(1, sizeof(TFTP_Resolution));
+    if (r != NULL) {
+        r->owners = malloc(sizeof(void *));
+    }
+    if (r == NULL || r->owners == NULL || start_pool() == -1) {
+        // Pas de thread disponible : résolution directe
+        if (r != NULL) {
+            free(r->owners);
+            free(r);
+        }
+        resolve(entry);
+        insert(entry, entry->num_wds > 0);
+        entry->refs = 1;
+        return entry;
+    }
+    r->entry = entry;
+    r->owners[0] = owner;
+    r->num_owners = 1;
+    r->next_pending = pending;
+    pending = r;
+    num_pending++;
+
+    pthread_mutex_lock(&pool.lock);
+    if (pool.queue_tail) {
+        pool.queue_tail->next_job = r;
+    } else {
+        pool.queue_head = r;
+    }
+    pool.queue_tail = r;
+    pthread_cond_signal(&pool.work);
+    pthread_mutex_unlock(&pool.lock);
+
+    errno = EINPROGRESS;
+    return NULL;
+}
+
+void cache_release(TFTP_CacheEntry *entry) {
+    if (entry == NULL) {
+        return;
+    }
+    entry->refs--;
+    if (entry->refs == 0 && entry->dead) {
+        free_entry(entry);
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef TFTP_CACHE_H
+#define TFTP_CACHE_H
+
+#include <sys/types.h>
+#include <time.h>
+
+// Nombre maximum d'entrées (positives + négatives) gardées en cache
+#define CACHE_MAX_ENTRIES 4096
+// Nombre maximum de descripteurs de fichiers gardés ouverts par le cache
+#define CACHE_MAX_OPEN_FDS 256
+// Nombre de threads qui ouvrent les fichiers absents du cache
+#define CACHE_THREADS 2
+
+// Résolution d'un chemin demandé par un client.
+// fd == -1 : recherche négative, err contient l'errno de l'échec (ENOENT, EACCES...)
+typedef struct TFTP_CacheEntry {
+    int fd;
+    int err;
+    off_t size;
+    time_t mtime;
+
+    // Champs internes au cache
+    char *path;
+    int *wds;        // répertoires surveillés, du départ du chemin au parent
+    size_t num_wds;
+    int refs;
+    int dead;
+    struct TFTP_CacheEntry *hash_next;
+    struct TFTP_CacheEntry *lru_prev, *lru_next;
+} TFTP_CacheEntry;
+
+// done(owner, entry) est appelée par cache_process() quand une recherche
+// absente du cache (cache_lookup à NULL, errno EINPROGRESS) est résolue ;
+// l'entrée est alors à libérer par cache_release(). Sans inotify, les
+// résultats ne sont jamais mis en cache.
+int cache_init(void (*done)(void *owner, TFTP_CacheEntry *entry));
+// Descripteurs à surveiller dans la boucle d'événements : inotify (-1 sans
+// cache) et eventfd des résolutions terminées
+int cache_fd(void);
+int cache_resolver_fd(void);
+void cache_process(void);
+// Recherches en cours de résolution
+size_t cache_pending(void);
+
+// Entrée en cache, ou NULL : errno EINPROGRESS si la résolution continue en
+// arrière-plan (done(owner, ...) suivra), sinon erreur mémoire
+TFTP_CacheEntry *cache_lookup(const char *path, void *owner);
+void cache_release(TFTP_CacheEntry *entry);
+
+#endif
@@ -0,0 +1,347 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <arpa/inet.h>
+
+#include "tftp_packet.h"
+#include "tftp_core.h"
+
+// WRQ fenêtré : blocs arrivés avant le bloc attendu (gigue ou perte), écrits
+// dès que le trou est comblé. Alloué au premier trou, libéré une fois vide.
+// Le bloc b (numéro sur 32 bits, comme seq) n'est gardé que pour
+// seq < b < seq + windowsize : chaque case (b % windowsize) ne contient
+// jamais qu'un seul bloc de la fenêtre.
+struct TFTP_Reorder {
+    uint64_t present;                  // bit (b % windowsize) : case occupée
+    uint16_t len[TFTP_MAX_WINDOWSIZE];
+    char data[][TFTP_DATA_PACKET_SIZE - 4];
+};
+
+_Static_assert(TFTP_MAX_WINDOWSIZE <= 64, "TFTP_Reorder.present : un bit par bloc de la fenêtre");
+
+static void core_log(const TFTP_CoreOps *ops, const char *fmt, ...) {
+    if (ops->log == NULL) {
+        return;
+    }
+    va_list ap;
+    va_start(ap, fmt);
+    ops->log(ops->ctx, fmt, ap);
+    va_end(ap);
+}
+
+static void send_error(const TFTP_CoreOps *ops, TFTP_Session *s, uint16_t errorCode, const char *errorMsg) {
+    TFTP_ErrorPacket errPacket;
+    size_t len = build_error_packet(&errPacket, errorCode, errorMsg);
+    ops->send(ops->ctx, s, &errPacket, len);
+}
+
+// Lecture et envoi du bloc s->seq (aussi utilisé pour les retransmissions).
+// Retourne 1 si les données ne sont pas encore disponibles (s->waiting).
+static int send_data_block(const TFTP_CoreOps *ops, TFTP_Session *s) {
+    TFTP_DataPacket data_packet;
+    off_t offset = (off_t)(s->seq - 1) * sizeof(data_packet.data);
+
+    ssize_t ret = ops->read(ops->ctx, s, offset, data_packet.data, sizeof(data_packet.data));
+    s->waiting = ret == -1 && errno == EAGAIN;
+    if (s->waiting) {
+        return 1;
+    }
+    if (ret == -1) {
+        core_log(ops, "Erreur lors de la lecture du fichier : %s\n", strerror(errno));
+        return -1;
+    }
+    s->last_len = (uint16_t)ret;
+
+    size_t packet_len = build_data_packet(&data_packet, (uint16_t)s->seq, s->last_len);
+    ops->send(ops->ctx, s, &data_packet, packet_len);
+    core_log(ops, "[DATA] Packet : %u (%u Bytes) -> @IP %s:%d\n", s->seq, s->last_len + 4u, inet_ntoa(s->peer.sin_addr), ntohs(s->peer.sin_port));
+    return 0;
+}
+
+// ACK du dernier bloc reçu (bloc 0 juste après le WRQ). Avec l'option
+// windowsize, le WRQ reçoit un OACK, répété tant que le bloc 1 n'est pas
+// arrivé ; chaque bloc reçu dans l'ordre reste acquitté, ce qui suffit à
+// l'émetteur pour faire avancer sa fenêtre.
+static void send_ack(const TFTP_CoreOps *ops, TFTP_Session *s) {
+    if (s->seq == 1 && s->windowsize != 0) {
+        char oack[TFTP_OACK_MAX_SIZE];
+        ops->send(ops->ctx, s, oack, build_oack_packet(oack, s->windowsize));
+        return;
+    }
+    TFTP_AckPacket ackPacket;
+    size_t len = build_ack_packet(&ackPacket, (uint16_t)(s->seq - 1));
+    ops->send(ops->ctx, s, &ackPacket, len);
+}
+
+int core_start(const TFTP_CoreOps *ops, TFTP_Session *s) {
+    s->seq = 1;
+    s->retries = 0;
+    if (s->opcode == TFTP_OPCODE_RRQ) {
+        // Envoi du premier bloc ; les suivants partent à la réception de chaque ACK
+        if (send_data_block(ops, s) == -1) {
+            send_error(ops, s, NotDefined, "Erreur lors de la lecture du fichier");
+            ops->close(ops->ctx, s);
+            return -1;
+        }
+    } else {
+        // Envoi du premier ACK (ou de l'OACK)
+        send_ack(ops, s);
+    }
+    ops->arm(ops->ctx, s, CORE_TIMEOUT_MS);
+    return 0;
+}
+
+static int write_failed(const TFTP_CoreOps *ops, TFTP_Session *s) {
+    core_log(ops, "Erreur lors de l'écriture dans le fichier : %s\n", strerror(errno));
+    // Envoi d'un paquet d'erreur au client
+    send_error(ops, s, DiskFullOrAllocationExceeded, "Erreur lors de l'écriture dans le fichier");
+    ops->close(ops->ctx, s);
+    return -1;
+}
+
+// Garde un bloc reçu en avance ; sans mémoire il est simplement ignoré et
+// sera retransmis par le client
+static void stash_block(TFTP_Session *s, uint32_t block, const char *data, size_t len) {
+    if (s->reorder == NULL) {
+        s->reorder = calloc(1, sizeof(struct TFTP_Reorder) + s->windowsize * sizeof(s->reorder->data[0]));
+        if (s->reorder == NULL) {
+            return;
+        }
+    }
+    unsigned slot = block % s->windowsize;
+    s->reorder->present |= 1ULL << slot;
+    s->reorder->len[slot] = (uint16_t)len;
+    memcpy(s->reorder->data[slot], data, len);
+}
+
+// Bloc s->seq s'il a été reçu en avance. Les données restent dans le tampon
+// jusqu'à la réception d'un nouveau bloc.
+static int take_block(TFTP_Session *s, const char **data, size_t *len) {
+    if (s->reorder == NULL) {
+        return 0;
+    }
+    unsigned slot = s->seq % s->windowsize;
+    if (!(s->reorder->present & (1ULL << slot))) {
+        return 0;
+    }
+    s->reorder->present &= ~(1ULL << slot);
+    *data = s->reorder->data[slot];
+    *len = s->reorder->len[slot];
+    return 1;
+}
+
+// WRQ : ACK du bloc s->seq - 1, une fois ses données prises par ops->write
+static int ack_received(const TFTP_CoreOps *ops, TFTP_Session *s, int last) {
+    s->retries = 0;
+    if (s->reorder != NULL && s->reorder->present == 0) {
+        free(s->reorder);
+        s->reorder = NULL;
+    }
+    send_ack(ops, s);
+
+    if (last) {
+        // Dernier paquet reçu : si l'ACK se perd, le client retransmet ce
+        // bloc, la session reste donc ouverte pour le réacquitter
+        core_log(ops, "|->Réception terminée avec succès. | file : %s (%zu):\n", s->filename, s->bytes);
+        s->done = 1;
+        ops->arm(ops->ctx, s, CORE_DALLY_MS);
+        return 0;
+    }
+    ops->arm(ops->ctx, s, CORE_TIMEOUT_MS);
+    return 0;
+}
+
+// WRQ : écriture du bloc attendu puis des blocs suivants déjà reçus, acquittés
+// ensemble par un seul ACK
+static int write_blocks(const TFTP_CoreOps *ops, TFTP_Session *s, const char *data, size_t len) {
+    int last;
+    do {
+        last = len < TFTP_DATA_PACKET_SIZE - 4;
+        s->bytes += len;
+        s->last_len = (uint16_t)len;
+
+        // Le dernier bloc n'est acquitté qu'une fois toutes les données
+        // écrites, pour pouvoir encore signaler une erreur au client
+        int ret = ops->write(ops->ctx, s, data, len, last);
+        if (ret == -1) {
+            return write_failed(ops, s);
+        }
+        s->seq++;
+        if (ret == 1) {
+            // Disque en retard : l'ACK attend core_resume(), le client ralentit
+            s->waiting = 1;
+            s->retries = 0;
+            ops->arm(ops->ctx, s, CORE_TIMEOUT_MS);
+            return 0;
+        }
+    } while (!last && take_block(s, &data, &len));
+    return ack_received(ops, s, last);
+}
+
+int core_resume(const TFTP_CoreOps *ops, TFTP_Session *s) {
+    if (!s->waiting) {
+        return 0;
+    }
+    if (s->opcode == TFTP_OPCODE_WRQ) {
+        // Écriture du bloc reçu terminée ou tampon libéré : l'ACK différé part
+        int last = s->last_len < TFTP_DATA_PACKET_SIZE - 4;
+        int ret = ops->write(ops->ctx, s, NULL, 0, last);
+        if (ret == -1) {
+            return write_failed(ops, s);
+        }
+        if (ret == 1) {
+            return 0;
+        }
+        s->waiting = 0;
+        const char *data;
+        size_t len;
+        if (!last && take_block(s, &data, &len)) {
+            return write_blocks(ops, s, data, len);
+        }
+        return ack_received(ops, s, last);
+    }
+
+    int ret = send_data_block(ops, s);
+    if (ret == -1) {
+        send_error(ops, s, NotDefined, "Erreur lors de la lecture du fichier");
+        ops->close(ops->ctx, s);
+        return -1;
+    }
+    if (ret == 0) {
+        s->retries = 0;
+        ops->arm(ops->ctx, s, CORE_TIMEOUT_MS);
+    }
+    return 0;
+}
+
+// Paquet reçu pendant un RRQ
+static int read_session_packet(const TFTP_CoreOps *ops, TFTP_Session *s, const char *buffer, size_t recvlen) {
+    TFTP_AckPacket ack_packet;
+    if (recvlen < sizeof(ack_packet)) {
+        return 0;
+    }
+    memcpy(&ack_packet, buffer, sizeof(ack_packet));
+
+    if (ack_packet.opcode == htons(TFTP_OPCODE_ERR)) {
+        core_log(ops, "Erreur reçue du client : %.*s\n", (int)(recvlen - 4), buffer + 4);
+        ops->close(ops->ctx, s);
+        return -1;
+    }
+    // Les ACK dupliqués ou d'un autre bloc sont ignorés
+    if (ack_packet.opcode != htons(TFTP_OPCODE_ACK) || ack_packet.block_num != htons((uint16_t)s->seq)) {
+        return 0;
+    }
+
+    core_log(ops, "[ACK] Packet : %u <- @IP %s:%d\n", ntohs(ack_packet.block_num), inet_ntoa(s->peer.sin_addr), ntohs(s->peer.sin_port));
+    s->bytes += s->last_len;
+    if (s->last_len < TFTP_DATA_PACKET_SIZE - 4) {
+        core_log(ops, "|->Transmission terminée avec succès. | file : %s (%zu):\n", s->filename, s->bytes);
+        ops->close(ops->ctx, s);
+        return -1;
+    }
+
+    s->seq++;
+    s->retries = 0;
+    if (send_data_block(ops, s) == -1) {
+        send_error(ops, s, NotDefined, "Erreur lors de la lecture du fichier");
+        ops->close(ops->ctx, s);
+        return -1;
+    }
+    ops->arm(ops->ctx, s, CORE_TIMEOUT_MS);
+    return 0;
+}
+
+// Paquet reçu pendant un WRQ
+static int write_session_packet(const TFTP_CoreOps *ops, TFTP_Session *s, const char *buffer, size_t recvlen) {
+    TFTP_DataPacket dataPacket;
+    if (recvlen < 4 || recvlen > sizeof(dataPacket)) {
+        return 0;
+    }
+    memcpy(&dataPacket, buffer, recvlen);
+
+    // Écriture en attente : l'ACK du dernier bloc n'est pas encore parti, les
+    // blocs suivants ou retransmis sont ignorés
+    if (s->waiting && dataPacket.opcode == htons(TFTP_OPCODE_DATA)) {
+        return 0;
+    }
+    // Transfert terminé : tout bloc retransmis reçoit l'ACK final (avec une
+    // fenêtre, le client peut encore attendre l'ACK d'un bloc antérieur)
+    if (s->done && dataPacket.opcode == htons(TFTP_OPCODE_DATA)) {
+        send_ack(ops, s);
+        return 0;
+    }
+
+    if (dataPacket.opcode == htons(TFTP_OPCODE_DATA)) {
+        // Bloc dupliqué ou hors séquence (client avec fenêtre d'envoi) : le
+        // dernier ACK est répété, le client y voit un ACK dupliqué et ne
+        // renvoie que le bloc manquant ; un bloc en avance dans la fenêtre
+        // est gardé jusque-là
+        uint16_t ahead = ntohs(dataPacket.block_num) - (uint16_t)s->seq;
+        if (ahead != 0) {
+            if (ahead < s->windowsize) {
+                stash_block(s, s->seq + ahead, dataPacket.data, recvlen - 4);
+            }
+            send_ack(ops, s);
+            return 0;
+        }
+        return write_blocks(ops, s, dataPacket.data, recvlen - 4);
+    } else if (ntohs(dataPacket.opcode) == TFTP_OPCODE_ERR) {
+        core_log(ops, "Erreur reçue du client : %.*s\n", (int)(recvlen - 4), dataPacket.data);
+    } else {
+        send_error(ops, s, NotDefined, "Paquet invalide reçu du serveur.");
+    }
+    ops->close(ops->ctx, s);
+    return -1;
+}
+
+int core_input(const TFTP_CoreOps *ops, TFTP_Session *s, const void *packet, size_t len) {
+    return s->opcode == TFTP_OPCODE_RRQ
+        ? read_session_packet(ops, s, packet, len)
+        : write_session_packet(ops, s, packet, len);
+}
+
+// Délai avant la prochaine retransmission (backoff exponentiel au-delà de
+// CORE_FAST_RETRIES)
+static unsigned retry_delay(const TFTP_Session *s) {
+    if (s->retries < CORE_FAST_RETRIES) return CORE_TIMEOUT_MS;
+    unsigned delay = CORE_TIMEOUT_MS << (s->retries - CORE_FAST_RETRIES + 1);
+    return delay < CORE_MAX_TIMEOUT_MS ? delay : CORE_MAX_TIMEOUT_MS;
+}
+
+int core_timeout(const TFTP_CoreOps *ops, TFTP_Session *s) {
+    // Fin de l'attente après le dernier ACK
+    if (s->done) {
+        ops->close(ops->ctx, s);
+        return -1;
+    }
+    // En attente de données ou d'écriture : le téléchargement amont et le
+    // disque ont leurs propres délais
+    if (s->waiting) {
+        ops->arm(ops->ctx, s, CORE_TIMEOUT_MS);
+        return 0;
+    }
+    if (s->retries >= CORE_MAX_RETRIES) {
+        core_log(ops, "[!] Nombre maximum de tentatives atteint, envoi d'un paquet d'erreur et abandon.\n");
+        send_error(ops, s, NotDefined, "Nombre maximum de tentatives atteint");
+        ops->close(ops->ctx, s);
+        return -1;
+    }
+    s->retries++;
+
+    if (s->opcode == TFTP_OPCODE_RRQ) {
+        // Timeout, retransmission
+        core_log(ops, "[TIMEOUT], retransmission du bloc %u\n", s->seq);
+        if (send_data_block(ops, s) == -1) {
+            ops->close(ops->ctx, s);
+            return -1;
+        }
+    } else {
+        // Timeout, retransmission de l'ACK précédent
+        core_log(ops, "Timeout, retransmission de l'ACK précédent\n");
+        send_ack(ops, s);
+    }
+    ops->arm(ops->ctx, s, retry_delay(s));
+    return 0;
+}
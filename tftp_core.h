@@ -0,0 +1,61 @@
+#ifndef TFTP_CORE_H
+#define TFTP_CORE_H
+
+#include <stddef.h>
+#include <stdarg.h>
+#include <sys/types.h>
+
+#include "tftp_session.h"
+
+// Délai de retransmission côté serveur : CORE_FAST_RETRIES tentatives à
+// CORE_TIMEOUT_MS, qui rattrapent vite une perte isolée, puis doublement
+// jusqu'à CORE_MAX_TIMEOUT_MS. Les CORE_MAX_RETRIES tentatives couvrent 26 s
+// de silence, plus que le client (20 s sans ACK nouveau), qui abandonne donc
+// le premier : une série de pertes ne fait plus échouer le transfert.
+#define CORE_TIMEOUT_MS 1000
+#define CORE_FAST_RETRIES 4
+#define CORE_MAX_TIMEOUT_MS 8000
+#define CORE_MAX_RETRIES 8
+// WRQ terminé : durée pendant laquelle l'ACK final est répété si le client
+// retransmet son dernier bloc (ACK perdu, RFC 1350 section 6). Le client
+// double son délai à chaque timeout : l'attente couvre ses retransmissions
+// à 1, 2 et 4 s au-delà de son RTO.
+#define CORE_DALLY_MS (CORE_TIMEOUT_MS * 8)
+
+// Machines à états RRQ et WRQ du serveur, indépendantes des sockets, des
+// fichiers et de l'horloge : tout passe par ces fonctions, fournies par la
+// boucle epoll du serveur ou par le simulateur (tftp_sim).
+typedef struct {
+    void *ctx;
+    // Envoi d'un paquet au client de la session (s->peer) depuis son TID
+    void (*send)(void *ctx, TFTP_Session *s, const void *packet, size_t len);
+    // RRQ : lecture des données du fichier à offset, retourne la taille lue ou -1.
+    // -1 avec errno EAGAIN : données pas encore disponibles, le bloc partira
+    // à l'appel de core_resume()
+    ssize_t (*read)(void *ctx, TFTP_Session *s, off_t offset, void *buf, size_t len);
+    // WRQ : écriture d'un bloc ; last : toutes les données doivent être écrites
+    // avant l'ACK. 0 : ACK envoyé ; -1 : erreur ; 1 : données gardées mais
+    // pas encore prises (ou, avec last, pas encore écrites) : l'ACK attend
+    // core_resume(), qui rappelle write(ctx, s, NULL, 0, last)
+    int (*write)(void *ctx, TFTP_Session *s, const void *data, size_t len, int last);
+    // (Ré)armement de la temporisation de la session, delay_ms après maintenant
+    void (*arm)(void *ctx, TFTP_Session *s, unsigned delay_ms);
+    // Fin de la session : elle ne doit plus être utilisée au retour
+    void (*close)(void *ctx, TFTP_Session *s);
+    // Journal, NULL pour ne rien afficher
+    void (*log)(void *ctx, const char *fmt, va_list ap);
+} TFTP_CoreOps;
+
+// Premier paquet d'une session (bloc 1 pour un RRQ, ACK 0 pour un WRQ) ;
+// s->opcode, s->peer et s->filename doivent être renseignés.
+// Ces fonctions retournent -1 si la session est terminée.
+int core_start(const TFTP_CoreOps *ops, TFTP_Session *s);
+// Paquet reçu du client de la session (le TID est déjà vérifié)
+int core_input(const TFTP_CoreOps *ops, TFTP_Session *s, const void *packet, size_t len);
+// Temporisation échue : retransmission, ou abandon après CORE_MAX_RETRIES tentatives
+int core_timeout(const TFTP_CoreOps *ops, TFTP_Session *s);
+// Nouvelles données disponibles ou écriture avancée : envoi du bloc ou de
+// l'ACK en attente (s->waiting)
+int core_resume(const TFTP_CoreOps *ops, TFTP_Session *s);
+
+#endif
@@ -0,0 +1,389 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <time.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/utsname.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "tftp_packet.h"
+#include "tftp_writer.h"
+
+// Micro-benchmarks des étapes d'un transfert, pris isolément : analyse de la
+// requête, construction des paquets DATA/ACK, sendErrorPacket, lecture et
+// écriture de blocs, aller-retour sendto/recvfrom sur loopback.
+//
+// Chaque benchmark est précédé d'un échauffement, puis mesuré sur
+// BENCH_REPETITIONS séries d'un nombre fixe d'itérations ; la médiane et le
+// minimum par opération sont écrits en JSON (nanosecondes et cycles TSC).
+
+#define BENCH_REPETITIONS 11
+#define BENCH_WARMUP_FRACTION 10 // échauffement = itérations / 10
+#define BENCH_FILE_SIZE (4 * 1024 * 1024)
+#define BENCH_BLOCK_SIZE 512
+
+typedef struct {
+    const char *name;
+    const char *description;
+    long iterations;
+    void (*setup)(void);
+    void (*run)(long iterations);
+    void (*teardown)(void);
+} Benchmark;
+
+typedef struct {
+    double ns_median, ns_min;
+    double cycles_median, cycles_min;
+} BenchResult;
+
+// Empêche le compilateur d'éliminer les calculs mesurés
+static volatile size_t sink;
+#define CLOBBER() __asm__ __volatile__("" ::: "memory")
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Cycles de référence du TSC (fréquence constante) ; 0 si indisponible
+static unsigned long long cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// ---- Analyse de la requête ----
+
+static const char rrq_packet[] = "\0\1pxelinux.cfg/01-52-54-00-12-34-56\0octet";
+
+static void bench_parse_request(long n) {
+    TFTP_Request request;
+    const char *errorMsg;
+    for (long i = 0; i < n; i++) {
+        sink += parse_request(rrq_packet, sizeof(rrq_packet), &request, &errorMsg);
+        CLOBBER();
+    }
+}
+
+// ---- Construction des paquets ----
+
+static void bench_build_data(long n) {
+    static TFTP_DataPacket packet;
+    for (long i = 0; i < n; i++) {
+        sink += build_data_packet(&packet, (uint16_t)i, BENCH_BLOCK_SIZE);
+        CLOBBER();
+    }
+}
+
+static void bench_build_ack(long n) {
+    static TFTP_AckPacket packet;
+    for (long i = 0; i < n; i++) {
+        sink += build_ack_packet(&packet, (uint16_t)i);
+        CLOBBER();
+    }
+}
+
+// ---- Sockets loopback ----
+
+static int sock_a = -1, sock_b = -1;
+static struct sockaddr_in addr_a, addr_b;
+
+static int bind_loopback(struct sockaddr_in *addr) {
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockfd == -1) {
+        perror("Erreur lors de la création du socket");
+        exit(1);
+    }
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(*addr);
+    if (bind(sockfd, (struct sockaddr *)addr, len) == -1 || getsockname(sockfd, (struct sockaddr *)addr, &len) == -1) {
+        perror("Erreur lors de la liaison du socket");
+        exit(1);
+    }
+    return sockfd;
+}
+
+static void setup_sockets(void) {
+    sock_a = bind_loopback(&addr_a);
+    sock_b = bind_loopback(&addr_b);
+}
+
+static void teardown_sockets(void) {
+    close(sock_a);
+    close(sock_b);
+}
+
+// sendErrorPacket vers un socket loopback vidé au fur et à mesure
+static void bench_send_error(long n) {
+    char buffer[MAX_PACKET_SIZE];
+    for (long i = 0; i < n; i++) {
+        sendErrorPacket(sock_a, addr_b, FileNotFound, "Fichier non trouvé");
+        sink += recv(sock_b, buffer, sizeof(buffer), 0);
+    }
+}
+
+// Un DATA de 516 octets dans un sens, l'ACK dans l'autre
+static void bench_loopback_round_trip(long n) {
+    TFTP_DataPacket data;
+    TFTP_AckPacket ack;
+    memset(data.data, 'x', sizeof(data.data));
+    for (long i = 0; i < n; i++) {
+        size_t len = build_data_packet(&data, (uint16_t)i, BENCH_BLOCK_SIZE);
+        sendto(sock_a, &data, len, 0, (struct sockaddr *)&addr_b, sizeof(addr_b));
+        recvfrom(sock_b, &data, sizeof(data), 0, NULL, NULL);
+        len = build_ack_packet(&ack, ntohs(data.block_num));
+        sendto(sock_b, &ack, len, 0, (struct sockaddr *)&addr_a, sizeof(addr_a));
+        sink += recvfrom(sock_a, &ack, sizeof(ack), 0, NULL, NULL);
+    }
+}
+
+// ---- Lecture et écriture de blocs ----
+
+static char bench_path[] = "/tmp/tftp_microbench.XXXXXX";
+static int bench_fd = -1;
+static FILE *bench_file;
+static TFTP_Writer *bench_writer;
+
+static void setup_file(void) {
+    bench_fd = mkstemp(bench_path);
+    if (bench_fd == -1) {
+        perror("Erreur lors de la création du fichier de test");
+        exit(1);
+    }
+    unlink(bench_path);
+    strcpy(bench_path + strlen(bench_path) - 6, "XXXXXX");
+
+    char block[BENCH_BLOCK_SIZE];
+    memset(block, 'x', sizeof(block));
+    for (size_t off = 0; off < BENCH_FILE_SIZE; off += sizeof(block)) {
+        if (write(bench_fd, block, sizeof(block)) != (ssize_t)sizeof(block)) {
+            perror("Erreur lors de l'écriture du fichier de test");
+            exit(1);
+        }
+    }
+    bench_file = fdopen(bench_fd, "r+");
+    if (bench_file == NULL) {
+        perror("fdopen");
+        exit(1);
+    }
+}
+
+static void teardown_file(void) {
+    fclose(bench_file);
+    bench_fd = -1;
+}
+
+// Fichier en cache de pages : seul le coût de l'appel et de la copie est mesuré
+static void bench_pread_block(long n) {
+    char block[BENCH_BLOCK_SIZE];
+    off_t offset = 0;
+    for (long i = 0; i < n; i++) {
+        sink += pread(bench_fd, block, sizeof(block), offset);
+        offset = (offset + BENCH_BLOCK_SIZE) % BENCH_FILE_SIZE;
+    }
+}
+
+static void bench_fread_block(long n) {
+    char block[BENCH_BLOCK_SIZE];
+    for (long i = 0; i < n; i++) {
+        if (i % (BENCH_FILE_SIZE / BENCH_BLOCK_SIZE) == 0) {
+            fseek(bench_file, 0, SEEK_SET);
+        }
+        sink += fread(block, 1, sizeof(block), bench_file);
+    }
+}
+
+static void bench_fwrite_block(long n) {
+    char block[BENCH_BLOCK_SIZE];
+    memset(block, 'y', sizeof(block));
+    for (long i = 0; i < n; i++) {
+        if (i % (BENCH_FILE_SIZE / BENCH_BLOCK_SIZE) == 0) {
+            fseek(bench_file, 0, SEEK_SET);
+        }
+        sink += fwrite(block, 1, sizeof(block), bench_file);
+    }
+    fflush(bench_file);
+}
+
+// Chemin d'écriture du serveur (WRQ) : copie dans la file des threads
+// d'écriture. File pleine : attente d'un tampon libre sur writer_fd(), comme
+// la boucle du serveur.
+static int bench_writer_ready;
+
+static void bench_writer_wake(void *owner) {
+    (void)owner;
+    bench_writer_ready = 1;
+}
+
+static void bench_writer_wait(void) {
+    struct pollfd pfd = { .fd = writer_fd(), .events = POLLIN };
+    bench_writer_ready = 0;
+    while (!bench_writer_ready) {
+        poll(&pfd, 1, -1);
+        writer_process();
+    }
+}
+
+static void setup_writer(void) {
+    setup_file();
+    if (writer_init(bench_writer_wake) == -1) {
+        perror("writer_init");
+        exit(1);
+    }
+    bench_writer = writer_new(bench_fd, NULL);
+    if (bench_writer == NULL) {
+        perror("writer_new");
+        exit(1);
+    }
+}
+
+static void teardown_writer(void) {
+    while (writer_finish(bench_writer) == 1) {
+        bench_writer_wait();
+    }
+    writer_free(bench_writer);
+    teardown_file();
+}
+
+static void bench_writer_queue_block(long n) {
+    char block[BENCH_BLOCK_SIZE];
+    memset(block, 'z', sizeof(block));
+    for (long i = 0; i < n; i++) {
+        int ret = writer_queue(bench_writer, block, sizeof(block));
+        while (ret == 1) {
+            bench_writer_wait();
+            ret = writer_queue(bench_writer, NULL, 0);
+        }
+        sink += ret;
+    }
+}
+
+static const Benchmark benchmarks[] = {
+    { "parse_request", "analyse RRQ (opcode, nom de fichier, mode)", 2000000, NULL, bench_parse_request, NULL },
+    { "build_data_packet", "construction de l'en-tête DATA", 10000000, NULL, bench_build_data, NULL },
+    { "build_ack_packet", "construction d'un ACK", 10000000, NULL, bench_build_ack, NULL },
+    { "send_error_packet", "sendErrorPacket + réception sur loopback", 100000, setup_sockets, bench_send_error, teardown_sockets },
+    { "pread_block", "pread d'un bloc de 512 octets (cache de pages)", 500000, setup_file, bench_pread_block, teardown_file },
+    { "fread_block", "fread d'un bloc de 512 octets", 500000, setup_file, bench_fread_block, teardown_file },
+    { "fwrite_block", "fwrite d'un bloc de 512 octets", 500000, setup_file, bench_fwrite_block, teardown_file },
+    { "writer_queue_block", "writer_queue d'un bloc de 512 octets", 20000, setup_writer, bench_writer_queue_block, teardown_writer },
+    { "loopback_round_trip", "DATA 516 octets + ACK, sendto/recvfrom loopback", 50000, setup_sockets, bench_loopback_round_trip, teardown_sockets },
+};
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static BenchResult run_benchmark(const Benchmark *b, long iterations) {
+    double ns[BENCH_REPETITIONS], cyc[BENCH_REPETITIONS];
+    BenchResult result;
+
+    if (b->setup) b->setup();
+    b->run(iterations / BENCH_WARMUP_FRACTION > 0 ? iterations / BENCH_WARMUP_FRACTION : 1);
+
+    for (int r = 0; r < BENCH_REPETITIONS; r++) {
+        double t0 = now_ns();
+        unsigned long long c0 = cycles();
+        b->run(iterations);
+        unsigned long long c1 = cycles();
+        double t1 = now_ns();
+        ns[r] = (t1 - t0) / iterations;
+        cyc[r] = (double)(c1 - c0) / iterations;
+    }
+    if (b->teardown) b->teardown();
+
+    qsort(ns, BENCH_REPETITIONS, sizeof(double), compare_double);
+    qsort(cyc, BENCH_REPETITIONS, sizeof(double), compare_double);
+    result.ns_median = ns[BENCH_REPETITIONS / 2];
+    result.ns_min = ns[0];
+    result.cycles_median = cyc[BENCH_REPETITIONS / 2];
+    result.cycles_min = cyc[0];
+    return result;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [-o <fichier JSON>] [-c <CPU>] [-s <facteur d'itérations>] [-f <filtre>]\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    const char *output = NULL, *filter = NULL;
+    int cpu = -1;
+    double scale = 1.0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "o:c:s:f:h")) != -1) {
+        switch (opt) {
+        case 'o': output = optarg; break;
+        case 'c': cpu = atoi(optarg); break;
+        case 's': scale = atof(optarg); break;
+        case 'f': filter = optarg; break;
+        default:
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+    if (scale <= 0) {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    // Épinglage sur un CPU pour des mesures stables
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+            perror("sched_setaffinity");
+        }
+    }
+
+    FILE *out = stdout;
+    if (output != NULL && (out = fopen(output, "w")) == NULL) {
+        perror("Erreur lors de l'ouverture du fichier de sortie");
+        exit(1);
+    }
+
+    struct utsname uts;
+    uname(&uts);
+    fprintf(out, "{\n  \"timestamp\": %ld,\n  \"host\": \"%s\",\n  \"kernel\": \"%s\",\n", (long)time(NULL), uts.nodename, uts.release);
+    fprintf(out, "  \"cpu\": %d,\n  \"repetitions\": %d,\n  \"cycles\": \"%s\",\n  \"benchmarks\": [", cpu,
+            BENCH_REPETITIONS, cycles() ? "tsc" : "none");
+
+    int first = 1;
+    for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+        const Benchmark *b = &benchmarks[i];
+        if (filter != NULL && strstr(b->name, filter) == NULL) {
+            continue;
+        }
+        long iterations = (long)(b->iterations * scale);
+        if (iterations < 1) iterations = 1;
+
+        BenchResult r = run_benchmark(b, iterations);
+        fprintf(stderr, "%-22s %10.1f ns/op (min %10.1f)  %10.1f cycles/op\n", b->name, r.ns_median, r.ns_min, r.cycles_median);
+        fprintf(out, "%s\n    {\"name\": \"%s\", \"description\": \"%s\", \"iterations\": %ld, "
+                "\"ns_per_op\": %.2f, \"ns_per_op_min\": %.2f, \"cycles_per_op\": %.1f, \"cycles_per_op_min\": %.1f}",
+                first ? "" : ",", b->name, b->description, iterations, r.ns_median, r.ns_min, r.cycles_median, r.cycles_min);
+        first = 0;
+    }
+    fprintf(out, "\n  ]\n}\n");
+
+    if (out != stdout) {
+        fclose(out);
+    }
+    return 0;
+}
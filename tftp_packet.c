@@ -0,0 +1,135 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "tftp_packet.h"
+
+// Tableau de messages d'erreur correspondant aux codes d'erreur TFTP
+const char* TFTPErrorMessages[NUM_TFTP_ERRORS] = {
+    "Not defined, see error message (if any)",
+    "File not found",
+    "Access violation",
+    "Disk full or allocation exceeded",
+    "Illegal TFTP operation",
+    "Unknown transfer ID",
+    "File already exists",
+    "No such user",
+    "Option refused"
+};
+
+int parse_request(const char *buffer, size_t len, TFTP_Request *request, const char **errorMsg) {
+    uint16_t opcode;
+    if (len < 2) {
+        *errorMsg = "Opcode non pris en charge";
+        return -1;
+    }
+    memcpy(&opcode, buffer, sizeof(uint16_t));
+    request->opcode = ntohs(opcode);
+    if (request->opcode != TFTP_OPCODE_RRQ && request->opcode != TFTP_OPCODE_WRQ) {
+        *errorMsg = "Opcode non pris en charge";
+        return -1;
+    }
+
+    // Extraction du nom de fichier (le paquet n'est pas forcément terminé par un octet nul)
+    const char *filename = buffer + 2;
+    const char *end = memchr(filename, '\0', len - 2);
+    size_t filename_length = end ? (size_t)(end - filename) : len - 2;
+    if (filename_length == 0) {
+        *errorMsg = "Nom de fichier vide";
+        return -1;
+    }
+    if (end == NULL || filename_length >= sizeof(request->filename)) {
+        *errorMsg = "Nom de fichier invalide";
+        return -1;
+    }
+    memcpy(request->filename, filename, filename_length + 1);
+
+    // Extraction du mode de transfert
+    size_t mode_offset = 2 + filename_length + 1; // Offset pour accéder au début du mode
+    const char *mode = buffer + mode_offset;
+    end = memchr(mode, '\0', len - mode_offset);
+    size_t mode_length = end ? (size_t)(end - mode) : len - mode_offset;
+    if (mode_length == 0 || mode_length >= sizeof(request->mode)) {
+        *errorMsg = "Mode de transfert non reconnu";
+        return -1;
+    }
+    memcpy(request->mode, mode, mode_length);
+    request->mode[mode_length] = '\0';
+    if (strcasecmp(request->mode, "netascii") != 0 && strcasecmp(request->mode, "octet") != 0) {
+        *errorMsg = "Mode de transfert non reconnu";
+        return -1;
+    }
+
+    // Options (RFC 2347) : paires nom/valeur après le mode. Seule windowsize
+    // (RFC 7440) est reconnue, les autres sont ignorées et absentes de l'OACK.
+    request->windowsize = 0;
+    size_t pos = mode_offset + mode_length + 1;
+    while (pos < len) {
+        const char *name = buffer + pos;
+        const char *name_end = memchr(name, '\0', len - pos);
+        if (name_end == NULL || name_end + 1 >= buffer + len) {
+            break;
+        }
+        const char *value = name_end + 1;
+        const char *value_end = memchr(value, '\0', buffer + len - value);
+        if (value_end == NULL) {
+            break;
+        }
+        if (strcasecmp(name, "windowsize") == 0) {
+            char *end_value;
+            long windowsize = strtol(value, &end_value, 10);
+            if (end_value != value && *end_value == '\0' && windowsize >= 1 && windowsize <= 65535) {
+                request->windowsize = windowsize < TFTP_MAX_WINDOWSIZE ? (uint16_t)windowsize : TFTP_MAX_WINDOWSIZE;
+            }
+        }
+        pos = value_end + 1 - buffer;
+    }
+    return 0;
+}
+
+size_t build_data_packet(TFTP_DataPacket *packet, uint16_t block_num, size_t data_len) {
+    packet->opcode = htons(TFTP_OPCODE_DATA);
+    packet->block_num = htons(block_num);
+    return data_len + 4;
+}
+
+size_t build_ack_packet(TFTP_AckPacket *packet, uint16_t block_num) {
+    packet->opcode = htons(TFTP_OPCODE_ACK);
+    packet->block_num = htons(block_num);
+    return sizeof(*packet);
+}
+
+size_t build_error_packet(TFTP_ErrorPacket *packet, uint16_t errorCode, const char *errorMsg) {
+    size_t msg_len = strnlen(errorMsg, sizeof(packet->err_msg) - 1);
+    packet->opcode = htons(TFTP_OPCODE_ERR);
+    packet->err_code = htons(errorCode);
+    memcpy(packet->err_msg, errorMsg, msg_len);
+    packet->err_msg[msg_len] = '\0';
+    return 4 + msg_len + 1;
+}
+
+size_t build_oack_packet(void *packet, uint16_t windowsize) {
+    char *p = packet;
+    uint16_t opcode = htons(TFTP_OPCODE_OACK);
+    memcpy(p, &opcode, sizeof(opcode));
+    int len = snprintf(p + 2, TFTP_OACK_MAX_SIZE - 2, "windowsize%c%u", '\0', windowsize);
+    return 2 + (size_t)len + 1;
+}
+
+void sendErrorPacket(int sockfd, struct sockaddr_in client_addr, uint16_t errorCode, const char *errorMsg) {
+    TFTP_ErrorPacket errPacket;
+    size_t len = build_error_packet(&errPacket, errorCode, errorMsg);
+    sendto(sockfd, &errPacket, len, 0, (struct sockaddr*)&client_addr, sizeof(client_addr));
+}
+
+const char* get_error_message(enum TFTPError error) {
+    if (error >= 0 && error < NUM_TFTP_ERRORS) {
+        return TFTPErrorMessages[error];
+    } else {
+        return "Unknown error";
+    }
+}
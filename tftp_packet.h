@@ -0,0 +1,73 @@
+#ifndef TFTP_PACKET_H
+#define TFTP_PACKET_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+
+#define TFTP_OPCODE_RRQ 1
+#define TFTP_OPCODE_WRQ 2
+#define TFTP_OPCODE_DATA 3
+#define TFTP_OPCODE_ACK 4
+#define TFTP_OPCODE_ERR 5
+#define TFTP_OPCODE_OACK 6
+
+// Fenêtre maximale acceptée pour l'option windowsize (RFC 7440)
+#define TFTP_MAX_WINDOWSIZE 64
+
+#define MAX_PACKET_SIZE 516
+#define TFTP_DATA_PACKET_SIZE 516
+#define TFTP_OACK_MAX_SIZE 32
+
+typedef struct {
+    uint16_t opcode;
+    char filename[512];
+    char mode[10]; // octet netascii
+    uint16_t windowsize; // option windowsize demandée (bornée à TFTP_MAX_WINDOWSIZE), 0 si absente
+} TFTP_Request;
+
+typedef struct {
+    uint16_t opcode;
+    uint16_t block_num;
+    char data[512];
+} TFTP_DataPacket;
+
+typedef struct {
+    uint16_t opcode;
+    uint16_t block_num;
+} TFTP_AckPacket;
+
+typedef struct {
+    uint16_t opcode;
+    uint16_t err_code;
+    char err_msg[512];
+} TFTP_ErrorPacket;
+
+enum TFTPError {
+    NotDefined = 0,
+    FileNotFound = 1,
+    AccessViolation = 2,
+    DiskFullOrAllocationExceeded = 3,
+    IllegalOperation = 4,
+    UnknownTransferID = 5,
+    FileAlreadyExists = 6,
+    NoSuchUser = 7,
+    OptionRefused = 8,
+    NUM_TFTP_ERRORS
+};
+
+// Analyse d'un RRQ/WRQ reçu sur le port 69 (opcode en ordre hôte dans request).
+// Retourne -1 et le message d'erreur à renvoyer au client si la requête est invalide.
+int parse_request(const char *buffer, size_t len, TFTP_Request *request, const char **errorMsg);
+
+// Construction des paquets DATA, ACK et ERROR ; retourne la taille à envoyer
+size_t build_data_packet(TFTP_DataPacket *packet, uint16_t block_num, size_t data_len);
+size_t build_ack_packet(TFTP_AckPacket *packet, uint16_t block_num);
+size_t build_error_packet(TFTP_ErrorPacket *packet, uint16_t errorCode, const char *errorMsg);
+// OACK (RFC 2347) acceptant l'option windowsize ; packet doit contenir TFTP_OACK_MAX_SIZE octets
+size_t build_oack_packet(void *packet, uint16_t windowsize);
+
+void sendErrorPacket(int sockfd, struct sockaddr_in client_addr, uint16_t errorCode, const char *errorMsg);
+const char* get_error_message(enum TFTPError error);
+
+#endif
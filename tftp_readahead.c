@@ -0,0 +1,485 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+
+#include "tftp_readahead.h"
+
+// Lecture anticipée des fichiers servis (RRQ). Chaque session garde un anneau
+// de chunks de READAHEAD_CHUNK_SIZE octets lus par un groupe de threads
+// partagé, à une distance du bloc courant adaptée à son débit. La mémoire
+// anticipée de toutes les sessions est bornée par un budget global, chunk
+// demandé compris : budget épuisé, la session lit directement son bloc avec
+// une pread() de 512 octets, sans tampon.
+//
+// La boucle d'événements n'attend jamais le disque : un chunk pas encore lu
+// donne EAGAIN, et la fin de sa lecture est signalée par un eventfd
+// (readahead_fd) ; readahead_process() appelle alors wake(owner).
+
+#define NUM_SLOTS (READAHEAD_MAX_DEPTH + 1)
+
+enum {
+    SLOT_EMPTY,
+    SLOT_PENDING,  // en file d'attente
+    SLOT_READING,  // lecture en cours par un thread
+    SLOT_READY,
+    SLOT_ERROR
+};
+
+typedef struct TFTP_ReadSlot {
+    TFTP_ReadAhead *ra;
+    off_t chunk;
+    char *buf;
+    size_t len;
+    int err;
+    int state;
+    struct TFTP_ReadSlot *next_job;
+} TFTP_ReadSlot;
+
+struct TFTP_ReadAhead {
+    int fd;                // copie du descripteur, fermée avec le pipeline
+    void *owner;
+    off_t size;
+    off_t num_chunks;
+    off_t current_chunk;   // dernier chunk consommé, -1 au départ
+    int depth;             // distance de lecture anticipée en chunks
+    int min_depth;         // plancher relevé après chaque attente du disque
+    int in_flight;         // slots en file ou en lecture
+    double last_chunk_ms;
+    double rate;           // débit de la session en octets/ms (moyenne glissante)
+    TFTP_ReadSlot *waiting_slot; // lecture attendue par la session (EAGAIN), NULL sinon
+    int closing;           // libéré par la session : la dernière lecture en cours le détruit
+    int ready_queued;
+    struct TFTP_ReadAhead *next_ready;
+    TFTP_ReadSlot slots[NUM_SLOTS];
+};
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t done;
+    TFTP_ReadSlot *queue_head, *queue_tail;
+    TFTP_ReadAhead *ready_head;   // sessions à réveiller par readahead_process()
+    size_t budget_chunks, used_chunks;
+    int max_depth;
+    int started;
+    int event_fd;
+    void (*wake)(void *owner);
+} pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .work = PTHREAD_COND_INITIALIZER,
+    .event_fd = -1,
+    .budget_chunks = READAHEAD_DEFAULT_BUDGET / READAHEAD_CHUNK_SIZE,
+    .max_depth = READAHEAD_MAX_DEPTH,
+};
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static ssize_t pread_full(int fd, char *buf, size_t len, off_t offset) {
+    size_t total = 0;
+    while (total < len) {
+        ssize_t n = pread(fd, buf + total, len - total, offset + total);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        total += n;
+    }
+    return total;
+}
+
+static void release_slot(TFTP_ReadSlot *slot) {
+    free(slot->buf);
+    slot->buf = NULL;
+    slot->chunk = -1;
+    slot->state = SLOT_EMPTY;
+    pool.used_chunks--;
+}
+
+// Signale à la boucle d'événements que la session attend ce slot. Appelé verrou pris ;
+// retourne 1 si l'eventfd doit être incrémenté.
+static int notify(TFTP_ReadAhead *ra, TFTP_ReadSlot *slot) {
+    if (ra->waiting_slot != slot) {
+        return 0;
+    }
+    ra->waiting_slot = NULL;
+    if (ra->ready_queued) {
+        return 0;
+    }
+    ra->ready_queued = 1;
+    ra->next_ready = pool.ready_head;
+    pool.ready_head = ra;
+    return 1;
+}
+
+static void destroy(TFTP_ReadAhead *ra) {
+    close(ra->fd);
+    free(ra);
+}
+
+static void *reader_thread(void *arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&pool.lock);
+    while (1) {
+        while (pool.queue_head == NULL) {
+            pthread_cond_wait(&pool.work, &pool.lock);
+        }
+        TFTP_ReadSlot *slot = pool.queue_head;
+        pool.queue_head = slot->next_job;
+        if (pool.queue_head == NULL) {
+            pool.queue_tail = NULL;
+        }
+        slot->state = SLOT_READING;
+        int fd = slot->ra->fd;
+        off_t offset = slot->chunk * READAHEAD_CHUNK_SIZE;
+        pthread_mutex_unlock(&pool.lock);
+
+        ssize_t n = pread_full(fd, slot->buf, READAHEAD_CHUNK_SIZE, offset);
+        int err = n == -1 ? errno : 0;
+
+        pthread_mutex_lock(&pool.lock);
+        TFTP_ReadAhead *ra = slot->ra;
+        slot->len = n == -1 ? 0 : (size_t)n;
+        slot->err = err;
+        slot->state = err ? SLOT_ERROR : SLOT_READY;
+        ra->in_flight--;
+
+        if (ra->closing) {
+            // Session déjà terminée : la dernière lecture libère le pipeline
+            release_slot(slot);
+            if (ra->in_flight == 0) {
+                pthread_mutex_unlock(&pool.lock);
+                destroy(ra);
+                pthread_mutex_lock(&pool.lock);
+            }
+        } else if (notify(ra, slot)) {
+            uint64_t one = 1;
+            ssize_t ret = write(pool.event_fd, &one, sizeof(one));
+            (void)ret; // compteur saturé : la boucle a déjà un réveil en attente
+        }
+    }
+    return NULL;
+}
+
+// Démarrage des threads à la première session qui en a besoin
+static int start_pool(void) {
+    if (pool.started) {
+        return 0;
+    }
+    for (int i = 0; i < READAHEAD_THREADS; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, reader_thread, NULL) != 0) {
+            return i == 0 ? -1 : 0;
+        }
+        pthread_detach(thread);
+    }
+    pool.started = 1;
+    return 0;
+}
+
+int readahead_init(int max_depth, size_t memory_budget, void (*wake)(void *owner)) {
+    if (max_depth < 1 || max_depth > READAHEAD_MAX_DEPTH) {
+        return -1;
+    }
+    if (pool.event_fd == -1 && memory_budget >= READAHEAD_CHUNK_SIZE) {
+        pool.event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (pool.event_fd == -1) {
+            return -1;
+        }
+    }
+    pthread_mutex_lock(&pool.lock);
+    pool.max_depth = max_depth;
+    pool.budget_chunks = memory_budget / READAHEAD_CHUNK_SIZE;
+    pool.wake = wake;
+    pthread_mutex_unlock(&pool.lock);
+    return 0;
+}
+
+int readahead_fd(void) {
+    return pool.event_fd;
+}
+
+void readahead_process(void) {
+    uint64_t count;
+    if (read(pool.event_fd, &count, sizeof(count)) == -1) {
+        return;
+    }
+
+    while (1) {
+        pthread_mutex_lock(&pool.lock);
+        TFTP_ReadAhead *ra = pool.ready_head;
+        if (ra != NULL) {
+            pool.ready_head = ra->next_ready;
+            ra->ready_queued = 0;
+        }
+        pthread_mutex_unlock(&pool.lock);
+        if (ra == NULL) {
+            break;
+        }
+        // Seule la boucle d'événements libère un pipeline actif : ra reste valide ici
+        pool.wake(ra->owner);
+    }
+}
+
+TFTP_ReadAhead *readahead_new(int fd, off_t size, void *owner) {
+    if (size < READAHEAD_MIN_FILE_SIZE || pool.budget_chunks == 0 || pool.event_fd == -1) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    int ret = start_pool();
+    pthread_mutex_unlock(&pool.lock);
+    if (ret == -1) {
+        return NULL;
+    }
+
+    TFTP_ReadAhead *ra = calloc(1, sizeof(TFTP_ReadAhead));
+    if (ra == NULL) {
+        return NULL;
+    }
+    // Copie du descripteur : une lecture peut finir après la fermeture de la session
+    ra->fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (ra->fd == -1) {
+        free(ra);
+        return NULL;
+    }
+    ra->owner = owner;
+    ra->size = size;
+    ra->num_chunks = (size + READAHEAD_CHUNK_SIZE - 1) / READAHEAD_CHUNK_SIZE;
+    ra->current_chunk = -1;
+    ra->depth = 1;
+    ra->min_depth = 1;
+    for (int i = 0; i < NUM_SLOTS; i++) {
+        ra->slots[i].ra = ra;
+        ra->slots[i].chunk = -1;
+    }
+
+    posix_fadvise(ra->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return ra;
+}
+
+// Met un chunk en file de lecture. Appelé verrou pris ; -1 si le budget est
+// épuisé ou si la mémoire manque.
+static int issue(TFTP_ReadAhead *ra, TFTP_ReadSlot *slot, off_t chunk) {
+    if (slot->buf == NULL) {
+        if (pool.used_chunks >= pool.budget_chunks) {
+            return -1;
+        }
+        slot->buf = malloc(READAHEAD_CHUNK_SIZE);
+        if (slot->buf == NULL) {
+            return -1;
+        }
+        pool.used_chunks++;
+    }
+    slot->chunk = chunk;
+    slot->state = SLOT_PENDING;
+    slot->next_job = NULL;
+    if (pool.queue_tail) {
+        pool.queue_tail->next_job = slot;
+    } else {
+        pool.queue_head = slot;
+    }
+    pool.queue_tail = slot;
+    ra->in_flight++;
+    pthread_cond_signal(&pool.work);
+    return 0;
+}
+
+// Passage à un nouveau chunk : libération des chunks consommés et ajustement
+// de la profondeur au débit mesuré de la session. Appelé verrou pris.
+static void advance(TFTP_ReadAhead *ra, off_t chunk) {
+    double now = now_ms();
+
+    if (ra->current_chunk >= 0 && chunk == ra->current_chunk + 1) {
+        double interval = now - ra->last_chunk_ms;
+        double rate = READAHEAD_CHUNK_SIZE / (interval > 0.001 ? interval : 0.001);
+        ra->rate = ra->rate == 0 ? rate : 0.75 * ra->rate + 0.25 * rate;
+
+        int depth = (int)(ra->rate * READAHEAD_HORIZON_MS / READAHEAD_CHUNK_SIZE) + 1;
+        if (depth < ra->min_depth) depth = ra->min_depth;
+        if (depth > pool.max_depth) depth = pool.max_depth;
+        ra->depth = depth;
+    }
+    ra->current_chunk = chunk;
+    ra->last_chunk_ms = now;
+
+    for (int i = 0; i < NUM_SLOTS; i++) {
+        TFTP_ReadSlot *slot = &ra->slots[i];
+        if (slot->buf != NULL && slot->chunk < chunk && (slot->state == SLOT_READY || slot->state == SLOT_ERROR)) {
+            release_slot(slot);
+        }
+    }
+}
+
+// Lance la lecture des chunks suivants jusqu'à la profondeur courante. Appelé verrou pris.
+static void prefetch(TFTP_ReadAhead *ra, off_t chunk) {
+    off_t last = chunk + ra->depth;
+    if (last >= ra->num_chunks) {
+        last = ra->num_chunks - 1;
+    }
+
+    off_t c;
+    for (c = chunk + 1; c <= last; c++) {
+        TFTP_ReadSlot *slot = &ra->slots[c % NUM_SLOTS];
+        if (slot->chunk == c || slot->state == SLOT_PENDING || slot->state == SLOT_READING) {
+            continue;
+        }
+        if (issue(ra, slot, c) == -1) {
+            break;
+        }
+    }
+
+    // Au-delà des tampons, le noyau peut déjà commencer à lire
+    if (c < ra->num_chunks) {
+        posix_fadvise(ra->fd, c * READAHEAD_CHUNK_SIZE, (off_t)ra->depth * READAHEAD_CHUNK_SIZE, POSIX_FADV_WILLNEED);
+    }
+}
+
+static int busy(const TFTP_ReadSlot *slot) {
+    return slot->state == SLOT_PENDING || slot->state == SLOT_READING;
+}
+
+// La session attend ce slot : EAGAIN, puis wake(owner) quand il est lu.
+// Appelé verrou pris, le relâche.
+static ssize_t would_block(TFTP_ReadAhead *ra, TFTP_ReadSlot *slot) {
+    ra->waiting_slot = slot;
+    pthread_mutex_unlock(&pool.lock);
+    errno = EAGAIN;
+    return -1;
+}
+
+// Lecture de len octets à offset depuis les chunks anticipés, sans jamais
+// attendre le disque : -1 avec EAGAIN tant qu'un chunk n'est pas lu.
+// L'appel est à refaire entièrement après wake(owner).
+ssize_t readahead_read(TFTP_ReadAhead *ra, off_t offset, void *buf, size_t len) {
+    size_t total = 0;
+
+    while (total < len && offset + (off_t)total < ra->size) {
+        off_t pos = offset + total;
+        off_t chunk = pos / READAHEAD_CHUNK_SIZE;
+        size_t in_chunk = pos % READAHEAD_CHUNK_SIZE;
+        size_t want = len - total;
+        if (want > READAHEAD_CHUNK_SIZE - in_chunk) {
+            want = READAHEAD_CHUNK_SIZE - in_chunk;
+        }
+
+        pthread_mutex_lock(&pool.lock);
+        int first = ra->current_chunk < 0;
+        if (chunk != ra->current_chunk) {
+            advance(ra, chunk);
+        }
+
+        TFTP_ReadSlot *slot = &ra->slots[chunk % NUM_SLOTS];
+        // Le slot peut encore contenir une lecture d'un autre chunk (retour en arrière)
+        if (slot->chunk != chunk && busy(slot)) {
+            return would_block(ra, slot);
+        }
+        if (slot->chunk != chunk && issue(ra, slot, chunk) == -1) {
+            // Budget épuisé : lecture directe de la partie demandée, bornée
+            // par len (un bloc), plutôt qu'un chunk de plus en mémoire
+            pthread_mutex_unlock(&pool.lock);
+            ssize_t n = pread_full(ra->fd, (char *)buf + total, want, pos);
+            if (n == -1) {
+                return total > 0 ? (ssize_t)total : -1;
+            }
+            total += n;
+            if ((size_t)n < want) {
+                break;
+            }
+            continue;
+        }
+        prefetch(ra, chunk);
+
+        if (busy(slot)) {
+            // Le réseau attend le disque : la session a besoin de plus d'avance
+            if (!first && ra->waiting_slot != slot && ra->min_depth < pool.max_depth) {
+                ra->min_depth++;
+            }
+            return would_block(ra, slot);
+        }
+        ra->waiting_slot = NULL;
+
+        if (slot->state == SLOT_ERROR) {
+            int err = slot->err;
+            release_slot(slot);
+            pthread_mutex_unlock(&pool.lock);
+            errno = err;
+            return total > 0 ? (ssize_t)total : -1;
+        }
+
+        size_t available = slot->len > in_chunk ? slot->len - in_chunk : 0;
+        if (want > available) {
+            want = available;
+        }
+        memcpy((char *)buf + total, slot->buf + in_chunk, want);
+        pthread_mutex_unlock(&pool.lock);
+
+        if (want == 0) {
+            // Fin de fichier atteinte plus tôt que prévu (fichier tronqué)
+            break;
+        }
+        total += want;
+    }
+    return total;
+}
+
+// Ne bloque pas : les lectures en cours se terminent en tâche de fond et la
+// dernière libère le pipeline.
+void readahead_free(TFTP_ReadAhead *ra) {
+    if (ra == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    // Retrait des lectures pas encore commencées
+    TFTP_ReadSlot **pp = &pool.queue_head;
+    pool.queue_tail = NULL;
+    while (*pp != NULL) {
+        if ((*pp)->ra == ra) {
+            (*pp)->state = SLOT_EMPTY;
+            ra->in_flight--;
+            *pp = (*pp)->next_job;
+        } else {
+            pool.queue_tail = *pp;
+            pp = &(*pp)->next_job;
+        }
+    }
+    if (ra->ready_queued) {
+        TFTP_ReadAhead **rp = &pool.ready_head;
+        while (*rp != ra) {
+            rp = &(*rp)->next_ready;
+        }
+        *rp = ra->next_ready;
+        ra->ready_queued = 0;
+    }
+    for (int i = 0; i < NUM_SLOTS; i++) {
+        if (ra->slots[i].buf != NULL && !busy(&ra->slots[i])) {
+            release_slot(&ra->slots[i]);
+        }
+    }
+    ra->waiting_slot = NULL;
+    ra->closing = 1;
+    int in_flight = ra->in_flight;
+    pthread_mutex_unlock(&pool.lock);
+
+    if (in_flight == 0) {
+        destroy(ra);
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef TFTP_READAHEAD_H
+#define TFTP_READAHEAD_H
+
+#include <sys/types.h>
+
+// Taille d'une lecture anticipée et profondeur maximale (en chunks) par session
+#define READAHEAD_CHUNK_SIZE (64 * 1024)
+#define READAHEAD_MAX_DEPTH 16
+// Fichiers plus petits lus directement, sans pipeline
+#define READAHEAD_MIN_FILE_SIZE (4 * READAHEAD_CHUNK_SIZE)
+// Durée de transfert que la lecture anticipée cherche à couvrir
+#define READAHEAD_HORIZON_MS 200.0
+// Nombre de threads de lecture partagés par toutes les sessions
+#define READAHEAD_THREADS 2
+// Mémoire totale des tampons de lecture anticipée, toutes sessions confondues
+#define READAHEAD_DEFAULT_BUDGET (64 * 1024 * 1024)
+
+typedef struct TFTP_ReadAhead TFTP_ReadAhead;
+
+// wake(owner) est appelée par readahead_process() quand le chunk qu'attendait
+// une session (readahead_read à -1, errno EAGAIN) est lu
+int readahead_init(int max_depth, size_t memory_budget, void (*wake)(void *owner));
+// eventfd à surveiller ; -1 sans lecture anticipée
+int readahead_fd(void);
+void readahead_process(void);
+
+TFTP_ReadAhead *readahead_new(int fd, off_t size, void *owner);
+ssize_t readahead_read(TFTP_ReadAhead *ra, off_t offset, void *buf, size_t len);
+void readahead_free(TFTP_ReadAhead *ra);
+
+#endif
@@ -0,0 +1,627 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#include "libtftp.h"
+#include "tftp_relay.h"
+
+// Le cache du relais est un répertoire : le fichier demandé "a/b" y est
+// gardé sous dir/a/b. Pendant le téléchargement, il est écrit dans
+// dir/.partial/ puis renommé une fois complet ; les sessions lisent le
+// fichier partiel jusqu'à la taille déjà reçue. Les fichiers complets sont
+// évincés du moins récemment utilisé au plus récent quand la taille totale
+// dépasse la limite. Les fichiers du cache ne sont pas revalidés auprès du
+// serveur amont : pour forcer un nouveau téléchargement, il suffit de les
+// supprimer.
+
+#define PARTIAL_DIR ".partial"
+
+typedef enum {
+    RELAY_FETCHING,
+    RELAY_READY,
+    RELAY_FAILED
+} RelayState;
+
+struct TFTP_RelayFile {
+    char *key;                  // chemin relatif dans le cache
+    RelayState state;
+    int fd;                     // ouvert tant que des sessions lisent le fichier
+    off_t size;                 // octets reçus (taille finale une fois complet)
+    TFTP_Transfer *transfer;    // téléchargement en cours
+    char *partial;              // chemin du fichier partiel
+
+    int error_code;
+    char error_message[512];
+
+    TFTP_Session **readers;
+    size_t num_readers, readers_capacity;
+    int waking;                 // sessions en cours de réveil : pas de libération
+
+    struct TFTP_RelayFile *hash_next;
+    struct TFTP_RelayFile *lru_prev, *lru_next; // fichiers complets
+    struct TFTP_RelayFile *fetch_next;          // téléchargements en cours
+};
+
+static int enabled;
+static int epfd = -1;
+static struct sockaddr_in upstream_addr;
+static char cache_dir[PATH_MAX];
+static char cache_real[PATH_MAX];   // chemin absolu résolu de cache_dir
+static uint64_t max_cache_bytes;
+static uint64_t cache_bytes;
+static void (*wake_session)(TFTP_Session *s);
+static int index_loaded;
+static unsigned long partial_counter;
+
+static TFTP_RelayFile *buckets[RELAY_BUCKETS];
+static TFTP_RelayFile *lru_head, *lru_tail;
+static TFTP_RelayFile *fetching;
+
+static uint32_t hash_key(const char *key) {
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (; *key; key++) {
+        h = (h ^ (uint8_t)*key) * 16777619u;
+    }
+    return h & (RELAY_BUCKETS - 1);
+}
+
+static TFTP_RelayFile *find_file(const char *key) {
+    for (TFTP_RelayFile *f = buckets[hash_key(key)]; f != NULL; f = f->hash_next) {
+        if (strcmp(f->key, key) == 0) {
+            return f;
+        }
+    }
+    return NULL;
+}
+
+static void hash_insert(TFTP_RelayFile *f) {
+    uint32_t h = hash_key(f->key);
+    f->hash_next = buckets[h];
+    buckets[h] = f;
+}
+
+static void hash_remove(TFTP_RelayFile *f) {
+    for (TFTP_RelayFile **p = &buckets[hash_key(f->key)]; *p != NULL; p = &(*p)->hash_next) {
+        if (*p == f) {
+            *p = f->hash_next;
+            return;
+        }
+    }
+}
+
+static void lru_unlink(TFTP_RelayFile *f) {
+    if (f->lru_prev) f->lru_prev->lru_next = f->lru_next; else if (lru_head == f) lru_head = f->lru_next;
+    if (f->lru_next) f->lru_next->lru_prev = f->lru_prev; else if (lru_tail == f) lru_tail = f->lru_prev;
+    f->lru_prev = f->lru_next = NULL;
+}
+
+static void lru_push_front(TFTP_RelayFile *f) {
+    f->lru_next = lru_head;
+    f->lru_prev = NULL;
+    if (lru_head) lru_head->lru_prev = f;
+    lru_head = f;
+    if (lru_tail == NULL) lru_tail = f;
+}
+
+// Chemin relatif sans composants vides, "." ni "..", et hors de .partial :
+// le relais n'écrit jamais en dehors de son répertoire
+static int relay_key(const char *filename, char *out, size_t out_size) {
+    size_t len = 0;
+    const char *p = filename;
+
+    while (*p) {
+        while (*p == '/') p++;
+        const char *start = p;
+        while (*p && *p != '/') p++;
+        size_t comp_len = p - start;
+        if (comp_len == 0 || (comp_len == 1 && start[0] == '.')) {
+            continue;
+        }
+        if ((comp_len == 2 && start[0] == '.' && start[1] == '.') ||
+            (len == 0 && comp_len == strlen(PARTIAL_DIR) && memcmp(start, PARTIAL_DIR, comp_len) == 0)) {
+            return -1;
+        }
+        if (len > 0) {
+            out[len++] = '/';
+        }
+        if (len + comp_len + 1 > out_size) {
+            return -1;
+        }
+        memcpy(out + len, start, comp_len);
+        len += comp_len;
+    }
+    out[len] = '\0';
+    return len == 0 ? -1 : 0;
+}
+
+static int cache_path(const char *key, char *out, size_t out_size) {
+    return snprintf(out, out_size, "%s/%s", cache_dir, key) < (int)out_size ? 0 : -1;
+}
+
+// Création des répertoires parents de path
+static int make_parents(const char *path) {
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s", path);
+    for (char *p = tmp + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            if (mkdir(tmp, 0755) == -1 && errno != EEXIST) {
+                return -1;
+            }
+            *p = '/';
+        }
+    }
+    return 0;
+}
+
+static TFTP_RelayFile *new_file(const char *key) {
+    TFTP_RelayFile *f = calloc(1, sizeof(TFTP_RelayFile));
+    if (f == NULL || (f->key = strdup(key)) == NULL) {
+        free(f);
+        return NULL;
+    }
+    f->fd = -1;
+    return f;
+}
+
+static void free_file(TFTP_RelayFile *f) {
+    if (f->fd != -1) {
+        close(f->fd);
+    }
+    free(f->readers);
+    free(f->partial);
+    free(f->key);
+    free(f);
+}
+
+// Éviction des fichiers complets non lus, du moins récemment utilisé au plus récent
+static void enforce_limit(void) {
+    TFTP_RelayFile *f = lru_tail;
+    while (cache_bytes > max_cache_bytes && f != NULL) {
+        TFTP_RelayFile *prev = f->lru_prev;
+        if (f->num_readers == 0) {
+            char path[PATH_MAX];
+            if (cache_path(f->key, path, sizeof(path)) == 0) {
+                unlink(path);
+            }
+            printf("[RELAIS] Éviction du cache : %s (%lld octets)\n", f->key, (long long)f->size);
+            cache_bytes -= f->size;
+            lru_unlink(f);
+            hash_remove(f);
+            free_file(f);
+        }
+        f = prev;
+    }
+}
+
+// ---- Index du cache, reconstruit depuis le disque au premier usage ----
+
+typedef struct {
+    char *key;
+    off_t size;
+    time_t mtime;
+} ScanEntry;
+
+static ScanEntry *scanned;
+static size_t num_scanned, scanned_capacity;
+
+static int scan_entry(const char *fpath, const struct stat *st, int type, struct FTW *ftw) {
+    (void)ftw;
+    const char *rel = fpath + strlen(cache_dir);
+    while (*rel == '/') rel++;
+    if (strncmp(rel, PARTIAL_DIR "/", strlen(PARTIAL_DIR) + 1) == 0) {
+        // Téléchargement interrompu par l'arrêt du serveur
+        if (type == FTW_F) {
+            unlink(fpath);
+        }
+        return 0;
+    }
+    if (type != FTW_F || !S_ISREG(st->st_mode)) {
+        return 0;
+    }
+    if (num_scanned == scanned_capacity) {
+        size_t capacity = scanned_capacity ? scanned_capacity * 2 : 64;
+        ScanEntry *entries = realloc(scanned, capacity * sizeof(ScanEntry));
+        if (entries == NULL) {
+            return 0;
+        }
+        scanned = entries;
+        scanned_capacity = capacity;
+    }
+    if ((scanned[num_scanned].key = strdup(rel)) != NULL) {
+        scanned[num_scanned].size = st->st_size;
+        scanned[num_scanned].mtime = st->st_mtime;
+        num_scanned++;
+    }
+    return 0;
+}
+
+static int compare_mtime(const void *a, const void *b) {
+    time_t ma = ((const ScanEntry *)a)->mtime, mb = ((const ScanEntry *)b)->mtime;
+    return (ma > mb) - (ma < mb);
+}
+
+static void load_index(void) {
+    index_loaded = 1;
+    nftw(cache_dir, scan_entry, 16, FTW_PHYS);
+
+    // Du plus ancien au plus récent : le plus récent finit en tête de la LRU
+    qsort(scanned, num_scanned, sizeof(ScanEntry), compare_mtime);
+    for (size_t i = 0; i < num_scanned; i++) {
+        TFTP_RelayFile *f = new_file(scanned[i].key);
+        if (f != NULL) {
+            f->state = RELAY_READY;
+            f->size = scanned[i].size;
+            cache_bytes += f->size;
+            hash_insert(f);
+            lru_push_front(f);
+        }
+        free(scanned[i].key);
+    }
+    free(scanned);
+    scanned = NULL;
+    num_scanned = scanned_capacity = 0;
+    printf("[RELAIS] Cache %s : %llu octets\n", cache_dir, (unsigned long long)cache_bytes);
+    enforce_limit();
+}
+
+// ---- Téléchargements depuis le serveur amont ----
+
+static ssize_t fetch_write(void *io, const void *buf, size_t len) {
+    TFTP_RelayFile *f = io;
+    ssize_t n = pwrite(f->fd, buf, len, f->size);
+    if (n > 0) {
+        f->size += n;
+        cache_bytes += n;
+    }
+    return n;
+}
+
+static int start_fetch(TFTP_RelayFile *f, const char *filename) {
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/" PARTIAL_DIR "/%lu", cache_dir, ++partial_counter) >= (int)sizeof(path) ||
+        make_parents(path) == -1 || (f->partial = strdup(path)) == NULL) {
+        return -1;
+    }
+    f->fd = open(f->partial, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (f->fd == -1) {
+        perror("[RELAIS] Erreur lors de la création du fichier du cache");
+        return -1;
+    }
+
+    TFTP_Options options;
+    memset(&options, 0, sizeof(options));
+    options.direction = TFTP_GET;
+    options.server = upstream_addr;
+    options.remote_filename = filename;
+    options.transfer_mode = "octet";
+    options.write = fetch_write;
+    options.io = f;
+    f->transfer = tftp_transfer_new(&options);
+    if (f->transfer == NULL) {
+        perror("[RELAIS] Erreur lors de la connexion au serveur amont");
+        unlink(f->partial);
+        return -1;
+    }
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = f };
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, tftp_transfer_fd(f->transfer), &ev) == -1) {
+        perror("epoll_ctl");
+        tftp_transfer_free(f->transfer);
+        f->transfer = NULL;
+        unlink(f->partial);
+        return -1;
+    }
+    f->state = RELAY_FETCHING;
+    f->fetch_next = fetching;
+    fetching = f;
+    printf("[RELAIS] Téléchargement de %s depuis %s:%d\n", filename, inet_ntoa(upstream_addr.sin_addr), ntohs(upstream_addr.sin_port));
+    return 0;
+}
+
+// Téléchargement terminé : le fichier prend sa place dans le cache, ou est supprimé
+static void finish_fetch(TFTP_RelayFile *f, int status) {
+    for (TFTP_RelayFile **p = &fetching; *p != NULL; p = &(*p)->fetch_next) {
+        if (*p == f) {
+            *p = f->fetch_next;
+            break;
+        }
+    }
+
+    char path[PATH_MAX];
+    if (status == LIBTFTP_DONE && (cache_path(f->key, path, sizeof(path)) == -1 || make_parents(path) == -1 ||
+                                rename(f->partial, path) == -1)) {
+        snprintf(f->error_message, sizeof(f->error_message), "Erreur lors de l'écriture dans le cache : %s", strerror(errno));
+        f->error_code = 0;
+        status = LIBTFTP_FAILED;
+    } else if (status == LIBTFTP_FAILED) {
+        // Erreur renvoyée par le serveur amont (fichier non trouvé...), transmise telle quelle
+        const char *message;
+        int code = tftp_transfer_remote_error(f->transfer, &message);
+        if (code != -1) {
+            f->error_code = code;
+            snprintf(f->error_message, sizeof(f->error_message), "%s", message);
+        } else {
+            f->error_code = 0;
+            snprintf(f->error_message, sizeof(f->error_message), "Serveur amont injoignable");
+        }
+    }
+    tftp_transfer_free(f->transfer);
+    f->transfer = NULL;
+
+    if (status == LIBTFTP_DONE) {
+        printf("[RELAIS] %s en cache (%lld octets)\n", f->key, (long long)f->size);
+        f->state = RELAY_READY;
+        lru_push_front(f);
+    } else {
+        printf("[RELAIS] Échec du téléchargement de %s : %s\n", f->key, f->error_message);
+        unlink(f->partial);
+        cache_bytes -= f->size;
+        f->state = RELAY_FAILED;
+        // Une nouvelle demande relancera le téléchargement
+        hash_remove(f);
+    }
+}
+
+// Réveil des sessions du fichier (parcours à rebours : une session fermée
+// est remplacée par la dernière, déjà réveillée)
+static void wake_readers(TFTP_RelayFile *f) {
+    f->waking = 1;
+    for (size_t i = f->num_readers; i-- > 0;) {
+        if (i < f->num_readers) {
+            wake_session(f->readers[i]);
+        }
+    }
+    f->waking = 0;
+}
+
+static void step_fetch(TFTP_RelayFile *f) {
+    off_t before = f->size;
+    int status = tftp_transfer_step(f->transfer);
+    if (status != LIBTFTP_RUNNING) {
+        finish_fetch(f, status);
+    }
+    if (f->size != before || status != LIBTFTP_RUNNING) {
+        wake_readers(f);
+    }
+    if (status != LIBTFTP_RUNNING && f->num_readers == 0) {
+        if (f->state == RELAY_FAILED) {
+            free_file(f);
+        } else {
+            close(f->fd);
+            f->fd = -1;
+            enforce_limit();
+        }
+    } else if (status == LIBTFTP_DONE) {
+        enforce_limit();
+    }
+}
+
+int relay_init(const char *upstream, const char *dir, uint64_t max_bytes, void (*wake)(TFTP_Session *s)) {
+    char host[256];
+    const char *port = "69";
+    const char *colon = strrchr(upstream, ':');
+    size_t host_len = colon ? (size_t)(colon - upstream) : strlen(upstream);
+    if (host_len == 0 || host_len >= sizeof(host)) {
+        return -1;
+    }
+    memcpy(host, upstream, host_len);
+    host[host_len] = '\0';
+    if (colon) {
+        port = colon + 1;
+    }
+
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    int err = getaddrinfo(host, port, &hints, &res);
+    if (err != 0) {
+        fprintf(stderr, "Serveur amont %s : %s\n", upstream, gai_strerror(err));
+        return -1;
+    }
+    memcpy(&upstream_addr, res->ai_addr, sizeof(upstream_addr));
+    freeaddrinfo(res);
+
+    size_t dir_len = strlen(dir);
+    while (dir_len > 1 && dir[dir_len - 1] == '/') {
+        dir_len--;
+    }
+    if (dir_len == 0 || dir_len >= sizeof(cache_dir)) {
+        return -1;
+    }
+    memcpy(cache_dir, dir, dir_len);
+    cache_dir[dir_len] = '\0';
+    if ((mkdir(cache_dir, 0755) == -1 && errno != EEXIST) || realpath(cache_dir, cache_real) == NULL) {
+        perror(cache_dir);
+        return -1;
+    }
+
+    if ((epfd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+        perror("epoll_create1");
+        return -1;
+    }
+    max_cache_bytes = max_bytes;
+    wake_session = wake;
+    enabled = 1;
+    return 0;
+}
+
+int relay_enabled(void) {
+    return enabled;
+}
+
+// Le cache est souvent dans le répertoire servi : ses fichiers (partiels ou
+// non) ne sont accessibles que par le relais, quel que soit le chemin
+// (".", "..", liens symboliques). Un fichier absent est jugé par son répertoire.
+int relay_in_cache(const char *filename) {
+    char resolved[PATH_MAX];
+    if (realpath(filename, resolved) == NULL) {
+        char dir[PATH_MAX] = ".";
+        const char *slash = strrchr(filename, '/');
+        if (slash != NULL) {
+            size_t dir_len = slash == filename ? 1 : (size_t)(slash - filename);
+            if (dir_len >= sizeof(dir)) {
+                return 0;
+            }
+            memcpy(dir, filename, dir_len);
+            dir[dir_len] = '\0';
+        }
+        if (realpath(dir, resolved) == NULL) {
+            return 0;
+        }
+    }
+    size_t len = strlen(cache_real);
+    return strncmp(resolved, cache_real, len) == 0 && (resolved[len] == '/' || resolved[len] == '\0');
+}
+
+int relay_fd(void) {
+    return epfd;
+}
+
+int relay_timeout(void) {
+    int timeout = -1;
+    for (TFTP_RelayFile *f = fetching; f != NULL; f = f->fetch_next) {
+        int t = tftp_transfer_timeout(f->transfer);
+        if (t != -1 && (timeout == -1 || t < timeout)) {
+            timeout = t;
+        }
+    }
+    return timeout;
+}
+
+void relay_process(void) {
+    struct epoll_event events[64];
+    int n = epoll_wait(epfd, events, 64, 0);
+    for (int i = 0; i < n; i++) {
+        step_fetch(events[i].data.ptr);
+    }
+
+    // Échéances (retransmissions vers le serveur amont)
+    TFTP_RelayFile *f = fetching;
+    while (f != NULL) {
+        TFTP_RelayFile *next = f->fetch_next;
+        if (tftp_transfer_timeout(f->transfer) == 0) {
+            step_fetch(f);
+        }
+        f = next;
+    }
+}
+
+static int add_reader(TFTP_RelayFile *f, TFTP_Session *s) {
+    if (f->num_readers == f->readers_capacity) {
+        size_t capacity = f->readers_capacity ? f->readers_capacity * 2 : 4;
+        TFTP_Session **readers = realloc(f->readers, capacity * sizeof(*readers));
+        if (readers == NULL) {
+            return -1;
+        }
+        f->readers = readers;
+        f->readers_capacity = capacity;
+    }
+    f->readers[f->num_readers++] = s;
+    return 0;
+}
+
+TFTP_RelayFile *relay_open(const char *filename, TFTP_Session *s) {
+    char key[PATH_MAX];
+    char path[PATH_MAX];
+
+    if (!index_loaded) {
+        load_index();
+    }
+    if (relay_key(filename, key, sizeof(key)) == -1 || cache_path(key, path, sizeof(path)) == -1) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    TFTP_RelayFile *f = find_file(key);
+    if (f != NULL && f->state == RELAY_READY && f->fd == -1 &&
+        (f->fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) {
+        // Supprimé du cache depuis : nouveau téléchargement
+        cache_bytes -= f->size;
+        lru_unlink(f);
+        hash_remove(f);
+        free_file(f);
+        f = NULL;
+    }
+    if (f == NULL) {
+        if ((f = new_file(key)) == NULL) {
+            return NULL;
+        }
+        if (start_fetch(f, filename) == -1) {
+            free_file(f);
+            return NULL;
+        }
+        hash_insert(f);
+    } else if (f->state == RELAY_READY) {
+        lru_unlink(f);
+        lru_push_front(f);
+    }
+
+    if (add_reader(f, s) == -1) {
+        if (f->num_readers == 0 && f->state == RELAY_READY) {
+            close(f->fd);
+            f->fd = -1;
+        }
+        return NULL;
+    }
+    return f;
+}
+
+void relay_detach(TFTP_RelayFile *f, TFTP_Session *s) {
+    for (size_t i = 0; i < f->num_readers; i++) {
+        if (f->readers[i] == s) {
+            f->readers[i] = f->readers[--f->num_readers];
+            break;
+        }
+    }
+    if (f->num_readers > 0 || f->waking || f->state == RELAY_FETCHING) {
+        return;
+    }
+    if (f->state == RELAY_FAILED) {
+        free_file(f);
+        return;
+    }
+    close(f->fd);
+    f->fd = -1;
+    enforce_limit();
+}
+
+ssize_t relay_read(TFTP_RelayFile *f, off_t offset, void *buf, size_t len) {
+    if (f->state == RELAY_FAILED) {
+        errno = EIO;
+        return -1;
+    }
+    // Bloc pas encore complet : on ne sait pas encore si c'est le dernier
+    if (f->state == RELAY_FETCHING && offset + (off_t)len > f->size) {
+        errno = EAGAIN;
+        return -1;
+    }
+    return pread(f->fd, buf, len, offset);
+}
+
+int relay_complete_fd(const TFTP_RelayFile *f, off_t *size) {
+    if (f->state != RELAY_READY) {
+        return -1;
+    }
+    *size = f->size;
+    return f->fd;
+}
+
+int relay_error(const TFTP_RelayFile *f, const char **message) {
+    if (f->state != RELAY_FAILED) {
+        return -1;
+    }
+    *message = f->error_message;
+    return f->error_code;
+}
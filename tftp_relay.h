@@ -0,0 +1,43 @@
+#ifndef TFTP_RELAY_H
+#define TFTP_RELAY_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "tftp_session.h"
+
+// Répertoire et taille par défaut du cache disque du relais
+#define RELAY_DEFAULT_DIR ".relay-cache"
+#define RELAY_DEFAULT_CACHE_MB 1024
+#define RELAY_BUCKETS 4096 // puissance de 2
+
+// Mode relais : un RRQ pour un fichier absent du répertoire servi est
+// téléchargé depuis le serveur amont (client libtftp) dans un cache disque
+// borné en taille. Les sessions lisent le fichier pendant son arrivée, et
+// les demandes simultanées d'un même fichier partagent le téléchargement.
+typedef struct TFTP_RelayFile TFTP_RelayFile;
+
+// upstream : "hôte[:port]". wake est appelée pour chaque session d'un fichier
+// qui reçoit de nouvelles données ou dont le téléchargement a échoué.
+int relay_init(const char *upstream, const char *dir, uint64_t max_bytes, void (*wake)(TFTP_Session *s));
+int relay_enabled(void);
+// 1 si filename désigne le répertoire du cache ou un fichier qu'il contient
+int relay_in_cache(const char *filename);
+// Descripteur epoll des téléchargements en cours, à surveiller par la boucle
+// d'événements ; relay_process() traite ses événements et ses échéances
+int relay_fd(void);
+int relay_timeout(void);
+void relay_process(void);
+
+// Fichier du cache pour la session s (téléchargement lancé s'il est absent).
+// NULL avec errno EINVAL si le nom ne peut pas être mis en cache.
+TFTP_RelayFile *relay_open(const char *filename, TFTP_Session *s);
+void relay_detach(TFTP_RelayFile *f, TFTP_Session *s);
+// -1 avec errno EAGAIN si les données ne sont pas encore arrivées
+ssize_t relay_read(TFTP_RelayFile *f, off_t offset, void *buf, size_t len);
+// Fichier complet : descripteur et taille, sinon -1
+int relay_complete_fd(const TFTP_RelayFile *f, off_t *size);
+// Téléchargement en échec : code d'erreur TFTP à renvoyer au client, sinon -1
+int relay_error(const TFTP_RelayFile *f, const char **message);
+
+#endif
@@ -0,0 +1,813 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// tftp-replay : rejoue contre un serveur local le trafic TFTP d'une capture
+// pcap. Chaque client de la capture (adresse:port ayant envoyé un RRQ ou un
+// WRQ) est reconstruit : instant de sa requête, délai entre chaque DATA reçu
+// et son ACK (RRQ) ou entre chaque ACK et le DATA suivant (WRQ), taille des
+// blocs envoyés et dernier bloc acquitté (clients qui abandonnent). Les
+// clients sont rejoués en parallèle, à la vitesse d'origine ou accélérée, et
+// la latence de réponse et le débit du serveur sont comparés à la capture.
+
+#define TFTP_OPCODE_RRQ 1
+#define TFTP_OPCODE_WRQ 2
+#define TFTP_OPCODE_DATA 3
+#define TFTP_OPCODE_ACK 4
+#define TFTP_OPCODE_ERR 5
+
+#define MAX_PACKET_SIZE 516
+#define FLOW_BUCKETS 4096
+
+// Retransmission côté client rejoué (non mise à l'échelle par la vitesse)
+#define REPLAY_TIMEOUT_MS 1000.0
+#define REPLAY_MAX_RETRIES 5
+
+// Types de lien pcap reconnus
+#define LINKTYPE_NULL 0
+#define LINKTYPE_ETHERNET 1
+#define LINKTYPE_RAW 101
+#define LINKTYPE_LOOP 108
+#define LINKTYPE_LINUX_SLL 113
+#define LINKTYPE_IPV4 228
+#define LINKTYPE_LINUX_SLL2 276
+
+typedef enum {
+    FLOW_WAITING,    // requête pas encore envoyée
+    FLOW_RUNNING,
+    FLOW_DONE,
+    FLOW_FAILED
+} FlowState;
+
+typedef struct Flow {
+    // Identité dans la capture
+    uint32_t client_ip;
+    uint16_t client_port;
+    uint16_t opcode;
+    char filename[256];
+    char mode[16];
+
+    // Comportement capturé (temps en secondes depuis le début de la capture)
+    double start;
+    double first_response;  // -1 si le serveur n'a jamais répondu
+    double end;
+    uint32_t last_block;    // RRQ : dernier bloc acquitté ; WRQ : dernier bloc envoyé
+    int capture_error;
+    size_t capture_bytes;
+    uint32_t num_blocks, capacity;
+    float *delay;           // RRQ : DATA(n) -> ACK(n) ; WRQ : ACK(n-1) -> DATA(n)
+    uint16_t *len;          // WRQ : taille de chaque bloc
+    double *pending_time;   // DATA (RRQ) ou ACK (WRQ) en attente de réponse du client
+
+    // Rejeu
+    FlowState state;
+    int sock;
+    struct sockaddr_in peer;
+    int connected;
+    uint32_t seq;            // RRQ : prochain DATA attendu ; WRQ : dernier DATA envoyé
+    int action_pending;      // ACK ou DATA programmé à deadline
+    int finish_after_action; // RRQ : l'ACK programmé acquitte le dernier bloc
+    double deadline;
+    int retries;
+    uint8_t last_packet[MAX_PACKET_SIZE];
+    size_t last_packet_len;
+    double request_at, response_at, finished_at;
+    size_t bytes;
+    int replay_error;
+
+    struct Flow *hash_next;
+} Flow;
+
+typedef struct {
+    double time;
+    Flow *flow;
+} TimerEntry;
+
+static Flow **flows;
+static size_t num_flows, flows_capacity;
+static Flow *flow_table[FLOW_BUCKETS];
+
+static size_t finished_flows;
+
+static TimerEntry *timers;
+static size_t num_timers, timers_capacity;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static uint16_t rd16(const uint8_t *p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint32_t swap32(uint32_t v) {
+    return (v >> 24) | ((v >> 8) & 0xFF00) | ((v << 8) & 0xFF0000) | (v << 24);
+}
+
+static Flow *find_flow(uint32_t ip, uint16_t port) {
+    for (Flow *f = flow_table[(ip ^ port) % FLOW_BUCKETS]; f != NULL; f = f->hash_next) {
+        if (f->client_ip == ip && f->client_port == port) {
+            return f;
+        }
+    }
+    return NULL;
+}
+
+static Flow *new_flow(uint32_t ip, uint16_t port) {
+    if (num_flows == flows_capacity) {
+        flows_capacity = flows_capacity ? flows_capacity * 2 : 256;
+        flows = realloc(flows, flows_capacity * sizeof(Flow *));
+        if (flows == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    Flow *f = calloc(1, sizeof(Flow));
+    if (f == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+    f->client_ip = ip;
+    f->client_port = port;
+    f->first_response = -1;
+    f->sock = -1;
+
+    // Une nouvelle requête du même client remplace l'ancienne dans la table
+    Flow **pp = &flow_table[(ip ^ port) % FLOW_BUCKETS];
+    while (*pp != NULL) {
+        if ((*pp)->client_ip == ip && (*pp)->client_port == port) {
+            *pp = (*pp)->hash_next;
+            break;
+        }
+        pp = &(*pp)->hash_next;
+    }
+    f->hash_next = flow_table[(ip ^ port) % FLOW_BUCKETS];
+    flow_table[(ip ^ port) % FLOW_BUCKETS] = f;
+    flows[num_flows++] = f;
+    return f;
+}
+
+// Retrouve le numéro de séquence complet d'un numéro de bloc 16 bits proche de ref
+static uint32_t unwrap(uint16_t block, uint32_t ref) {
+    uint32_t seq = (ref & ~0xFFFFu) | block;
+    if (seq + 0x8000 < ref) {
+        seq += 0x10000;
+    } else if (seq > ref + 0x8000 && seq >= 0x10000) {
+        seq -= 0x10000;
+    }
+    return seq;
+}
+
+static void ensure_blocks(Flow *f, uint32_t seq) {
+    if (seq < f->capacity) {
+        return;
+    }
+    uint32_t capacity = f->capacity ? f->capacity : 64;
+    while (capacity <= seq) {
+        capacity *= 2;
+    }
+    f->delay = realloc(f->delay, capacity * sizeof(float));
+    f->len = realloc(f->len, capacity * sizeof(uint16_t));
+    f->pending_time = realloc(f->pending_time, capacity * sizeof(double));
+    if (f->delay == NULL || f->len == NULL || f->pending_time == NULL) {
+        perror("realloc");
+        exit(1);
+    }
+    for (uint32_t i = f->capacity; i < capacity; i++) {
+        f->delay[i] = 0;
+        f->len[i] = 0;
+        f->pending_time[i] = -1;
+    }
+    f->capacity = capacity;
+}
+
+// Paquet client -> serveur
+static void capture_from_client(Flow *f, double t, const uint8_t *p, size_t len) {
+    uint16_t opcode = rd16(p);
+    f->end = t;
+
+    if (f->opcode == TFTP_OPCODE_RRQ && opcode == TFTP_OPCODE_ACK) {
+        uint32_t seq = unwrap(rd16(p + 2), f->last_block);
+        if (seq <= f->last_block && f->last_block != 0) {
+            return;
+        }
+        ensure_blocks(f, seq);
+        if (f->pending_time[seq] >= 0) {
+            f->delay[seq] = (float)(t - f->pending_time[seq]);
+        }
+        f->last_block = seq;
+        if (seq >= f->num_blocks) {
+            f->num_blocks = seq + 1;
+        }
+    } else if (f->opcode == TFTP_OPCODE_WRQ && opcode == TFTP_OPCODE_DATA) {
+        uint32_t seq = unwrap(rd16(p + 2), f->last_block);
+        if (seq <= f->last_block) {
+            return; // retransmission
+        }
+        ensure_blocks(f, seq);
+        f->delay[seq] = f->pending_time[seq - 1] >= 0 ? (float)(t - f->pending_time[seq - 1]) : 0;
+        f->len[seq] = (uint16_t)(len - 4);
+        f->capture_bytes += len - 4;
+        f->last_block = seq;
+        f->num_blocks = seq + 1;
+    }
+}
+
+// Paquet serveur -> client
+static void capture_from_server(Flow *f, double t, const uint8_t *p, size_t len) {
+    uint16_t opcode = rd16(p);
+    if (f->first_response < 0) {
+        f->first_response = t;
+    }
+    f->end = t;
+
+    if (opcode == TFTP_OPCODE_ERR) {
+        f->capture_error = 1;
+    } else if (f->opcode == TFTP_OPCODE_RRQ && opcode == TFTP_OPCODE_DATA) {
+        uint32_t seq = unwrap(rd16(p + 2), f->last_block + 1);
+        ensure_blocks(f, seq);
+        if (f->pending_time[seq] < 0) {
+            f->capture_bytes += len - 4;
+        }
+        f->pending_time[seq] = t;
+    } else if (f->opcode == TFTP_OPCODE_WRQ && opcode == TFTP_OPCODE_ACK) {
+        uint32_t seq = unwrap(rd16(p + 2), f->last_block);
+        ensure_blocks(f, seq + 1);
+        if (f->pending_time[seq] < 0) {
+            f->pending_time[seq] = t;
+        }
+    }
+}
+
+static void capture_packet(double t, uint32_t src, uint16_t sport, uint32_t dst, uint16_t dport,
+                           const uint8_t *p, size_t len, size_t captured, uint16_t server_port) {
+    if (len < 4 || captured < 4) {
+        return;
+    }
+    uint16_t opcode = rd16(p);
+
+    if (dport == server_port && (opcode == TFTP_OPCODE_RRQ || opcode == TFTP_OPCODE_WRQ)) {
+        Flow *f = find_flow(src, sport);
+        if (f != NULL && f->first_response < 0) {
+            return; // requête retransmise
+        }
+        f = new_flow(src, sport);
+        f->opcode = opcode;
+        f->start = f->end = t;
+
+        // Nom de fichier et mode, terminés par un octet nul
+        len = captured;
+        const char *name = (const char *)p + 2;
+        size_t name_len = strnlen(name, len - 2);
+        snprintf(f->filename, sizeof(f->filename), "%.*s", (int)name_len, name);
+        if (2 + name_len + 1 < len) {
+            const char *mode = name + name_len + 1;
+            snprintf(f->mode, sizeof(f->mode), "%.*s", (int)strnlen(mode, len - 3 - name_len), mode);
+        } else {
+            strcpy(f->mode, "octet");
+        }
+        return;
+    }
+
+    Flow *f;
+    if ((f = find_flow(src, sport)) != NULL) {
+        capture_from_client(f, t, p, len);
+    } else if ((f = find_flow(dst, dport)) != NULL) {
+        capture_from_server(f, t, p, len);
+    }
+}
+
+// Lecture de la capture ; retourne le nombre de paquets UDP analysés
+static long load_pcap(const char *path, uint16_t server_port) {
+    FILE *in = fopen(path, "rb");
+    if (in == NULL) {
+        perror("Erreur lors de l'ouverture de la capture");
+        exit(1);
+    }
+
+    uint8_t header[24];
+    if (fread(header, 1, sizeof(header), in) != sizeof(header)) {
+        fprintf(stderr, "Capture trop courte\n");
+        exit(1);
+    }
+
+    uint32_t magic;
+    memcpy(&magic, header, 4);
+    int swapped = 0;
+    double ts_scale = 1e-6;
+    if (magic == 0xa1b2c3d4 || magic == 0xa1b23c4d) {
+        ts_scale = magic == 0xa1b23c4d ? 1e-9 : 1e-6;
+    } else if (magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1) {
+        swapped = 1;
+        ts_scale = magic == 0x4d3cb2a1 ? 1e-9 : 1e-6;
+    } else {
+        fprintf(stderr, "Format de capture non reconnu (pcapng non supporté, convertir avec editcap -F pcap)\n");
+        exit(1);
+    }
+    uint32_t linktype;
+    memcpy(&linktype, header + 20, 4);
+    if (swapped) linktype = swap32(linktype);
+    linktype &= 0xFFFF;
+
+    static uint8_t packet[262144];
+    uint8_t record[16];
+    double first_ts = -1;
+    long count = 0;
+
+    while (fread(record, 1, sizeof(record), in) == sizeof(record)) {
+        uint32_t sec, frac, incl_len;
+        memcpy(&sec, record, 4);
+        memcpy(&frac, record + 4, 4);
+        memcpy(&incl_len, record + 8, 4);
+        if (swapped) {
+            sec = swap32(sec);
+            frac = swap32(frac);
+            incl_len = swap32(incl_len);
+        }
+        if (incl_len > sizeof(packet) || fread(packet, 1, incl_len, in) != incl_len) {
+            break;
+        }
+        double ts = sec + frac * ts_scale;
+        if (first_ts < 0) {
+            first_ts = ts;
+        }
+
+        // En-tête de lien
+        size_t off;
+        uint16_t proto = 0x0800;
+        switch (linktype) {
+        case LINKTYPE_ETHERNET:
+            if (incl_len < 14) continue;
+            off = 14;
+            proto = rd16(packet + 12);
+            if (proto == 0x8100 && incl_len >= 18) {
+                proto = rd16(packet + 16);
+                off = 18;
+            }
+            break;
+        case LINKTYPE_LINUX_SLL:
+            if (incl_len < 16) continue;
+            off = 16;
+            proto = rd16(packet + 14);
+            break;
+        case LINKTYPE_LINUX_SLL2:
+            if (incl_len < 20) continue;
+            off = 20;
+            proto = rd16(packet);
+            break;
+        case LINKTYPE_NULL:
+        case LINKTYPE_LOOP:
+            off = 4;
+            break;
+        case LINKTYPE_RAW:
+        case LINKTYPE_IPV4:
+            off = 0;
+            break;
+        default:
+            fprintf(stderr, "Type de lien pcap %u non supporté\n", linktype);
+            exit(1);
+        }
+        if (proto != 0x0800 || incl_len < off + 20) {
+            continue;
+        }
+
+        // IPv4 + UDP, sans les fragments non initiaux
+        const uint8_t *ip = packet + off;
+        size_t ihl = (ip[0] & 0x0F) * 4;
+        if ((ip[0] >> 4) != 4 || ip[9] != 17 || (rd16(ip + 6) & 0x1FFF) != 0 || incl_len < off + ihl + 8) {
+            continue;
+        }
+        uint32_t src, dst;
+        memcpy(&src, ip + 12, 4);
+        memcpy(&dst, ip + 16, 4);
+        const uint8_t *udp = ip + ihl;
+        size_t udp_len = rd16(udp + 4);
+        size_t available = incl_len - off - ihl;
+        if (udp_len < 8) {
+            continue;
+        }
+        // Capture tronquée (snaplen) : seule la taille des blocs compte pour le rejeu
+        size_t payload_len = udp_len - 8;
+        size_t captured = available - 8 < payload_len ? available - 8 : payload_len;
+        capture_packet(ts - first_ts, src, rd16(udp), dst, rd16(udp + 2), udp + 8,
+                       payload_len, captured, server_port);
+        count++;
+    }
+    fclose(in);
+    return count;
+}
+
+// Tas de temporisations ; les entrées périmées (deadline modifiée) sont ignorées
+static void timer_push(double time, Flow *f) {
+    if (num_timers == timers_capacity) {
+        timers_capacity = timers_capacity ? timers_capacity * 2 : 1024;
+        timers = realloc(timers, timers_capacity * sizeof(TimerEntry));
+        if (timers == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    size_t i = num_timers++;
+    while (i > 0 && timers[(i - 1) / 2].time > time) {
+        timers[i] = timers[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    timers[i].time = time;
+    timers[i].flow = f;
+}
+
+static TimerEntry timer_pop(void) {
+    TimerEntry top = timers[0];
+    TimerEntry last = timers[--num_timers];
+    size_t i = 0;
+    while (2 * i + 1 < num_timers) {
+        size_t child = 2 * i + 1;
+        if (child + 1 < num_timers && timers[child + 1].time < timers[child].time) {
+            child++;
+        }
+        if (last.time <= timers[child].time) {
+            break;
+        }
+        timers[i] = timers[child];
+        i = child;
+    }
+    if (num_timers > 0) {
+        timers[i] = last;
+    }
+    return top;
+}
+
+static void set_deadline(Flow *f, double time) {
+    f->deadline = time;
+    timer_push(time, f);
+}
+
+static void flow_send(Flow *f, const uint8_t *packet, size_t len) {
+    memcpy(f->last_packet, packet, len);
+    f->last_packet_len = len;
+    sendto(f->sock, packet, len, 0, (struct sockaddr *)&f->peer, sizeof(f->peer));
+}
+
+static void flow_finish(Flow *f, FlowState state, double now) {
+    f->state = state;
+    f->finished_at = now;
+    finished_flows++;
+    f->action_pending = 0;
+    f->deadline = 0;
+}
+
+static double speed = 1.0;
+
+static double scaled(double seconds) {
+    return speed > 0 ? seconds * 1000.0 / speed : 0;
+}
+
+// Envoi de l'action programmée (requête, ACK ou DATA) d'un client
+static void flow_action(Flow *f, int epfd, double now) {
+    uint8_t packet[MAX_PACKET_SIZE];
+
+    if (f->state == FLOW_WAITING) {
+        f->sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+        if (f->sock == -1) {
+            perror("Erreur lors de la création du socket");
+            flow_finish(f, FLOW_FAILED, now);
+            return;
+        }
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = f };
+        epoll_ctl(epfd, EPOLL_CTL_ADD, f->sock, &ev);
+
+        size_t name_len = strlen(f->filename), mode_len = strlen(f->mode);
+        packet[0] = 0;
+        packet[1] = (uint8_t)f->opcode;
+        memcpy(packet + 2, f->filename, name_len + 1);
+        memcpy(packet + 3 + name_len, f->mode, mode_len + 1);
+        flow_send(f, packet, 4 + name_len + mode_len);
+        f->state = FLOW_RUNNING;
+        f->request_at = now;
+        f->seq = f->opcode == TFTP_OPCODE_RRQ ? 1 : 0;
+        set_deadline(f, now + REPLAY_TIMEOUT_MS);
+        return;
+    }
+
+    f->action_pending = 0;
+    f->retries = 0;
+    if (f->opcode == TFTP_OPCODE_RRQ) {
+        // ACK du bloc seq - 1 après le délai de réflexion du client capturé
+        uint32_t acked = f->seq - 1;
+        packet[0] = 0;
+        packet[1] = TFTP_OPCODE_ACK;
+        packet[2] = (uint8_t)(acked >> 8);
+        packet[3] = (uint8_t)acked;
+        flow_send(f, packet, 4);
+        if (f->finish_after_action) {
+            flow_finish(f, FLOW_DONE, now);
+            return;
+        }
+    } else {
+        // DATA suivant, rempli de zéros à la taille capturée
+        f->seq++;
+        size_t len = f->len[f->seq];
+        packet[0] = 0;
+        packet[1] = TFTP_OPCODE_DATA;
+        packet[2] = (uint8_t)(f->seq >> 8);
+        packet[3] = (uint8_t)f->seq;
+        memset(packet + 4, 0, len);
+        flow_send(f, packet, 4 + len);
+        f->bytes += len;
+    }
+    set_deadline(f, now + REPLAY_TIMEOUT_MS);
+}
+
+static void flow_timeout(Flow *f, double now) {
+    if (f->retries >= REPLAY_MAX_RETRIES) {
+        flow_finish(f, FLOW_FAILED, now);
+        return;
+    }
+    f->retries++;
+    sendto(f->sock, f->last_packet, f->last_packet_len, 0, (struct sockaddr *)&f->peer, sizeof(f->peer));
+    set_deadline(f, now + REPLAY_TIMEOUT_MS);
+}
+
+static void flow_receive(Flow *f, const uint8_t *p, size_t len, const struct sockaddr_in *from, double now) {
+    if (f->state != FLOW_RUNNING || len < 4) {
+        return;
+    }
+    if (f->response_at == 0) {
+        f->response_at = now;
+    }
+    if (!f->connected) {
+        f->peer = *from;
+        f->connected = 1;
+    }
+
+    uint16_t opcode = rd16(p);
+    uint16_t block = rd16(p + 2);
+
+    if (opcode == TFTP_OPCODE_ERR) {
+        f->replay_error = 1;
+        flow_finish(f, FLOW_DONE, now);
+        return;
+    }
+
+    if (f->opcode == TFTP_OPCODE_RRQ && opcode == TFTP_OPCODE_DATA) {
+        if (block == (uint16_t)f->seq && !f->action_pending) {
+            f->bytes += len - 4;
+            int last = len < MAX_PACKET_SIZE;
+            // Le client capturé a abandonné avant ce bloc : le rejeu s'arrête aussi
+            if (f->seq > f->last_block) {
+                flow_finish(f, FLOW_DONE, now);
+                return;
+            }
+            double delay = f->seq < f->capacity ? scaled(f->delay[f->seq]) : 0;
+            f->seq++;
+            f->action_pending = 1;
+            f->finish_after_action = last;
+            set_deadline(f, now + delay);
+        } else if (block == (uint16_t)(f->seq - 1) && !f->action_pending) {
+            // DATA retransmis : répétition de l'ACK
+            sendto(f->sock, f->last_packet, f->last_packet_len, 0, (struct sockaddr *)&f->peer, sizeof(f->peer));
+        }
+    } else if (f->opcode == TFTP_OPCODE_WRQ && opcode == TFTP_OPCODE_ACK) {
+        if (block != (uint16_t)f->seq || f->action_pending) {
+            return;
+        }
+        if (f->seq >= f->last_block) {
+            // Dernier bloc capturé acquitté
+            flow_finish(f, FLOW_DONE, now);
+            return;
+        }
+        double delay = f->seq + 1 < f->capacity ? scaled(f->delay[f->seq + 1]) : 0;
+        f->action_pending = 1;
+        set_deadline(f, now + delay);
+    }
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(double *values, size_t n, double p) {
+    if (n == 0) {
+        return 0;
+    }
+    size_t idx = (size_t)(p * (n - 1) + 0.5);
+    return values[idx];
+}
+
+static void report_series(const char *label, double *capture, double *replay, size_t n) {
+    qsort(capture, n, sizeof(double), compare_double);
+    qsort(replay, n, sizeof(double), compare_double);
+    printf("%-28s p50 %9.3f / %9.3f   p90 %9.3f / %9.3f   p99 %9.3f / %9.3f\n", label,
+           percentile(capture, n, 0.5), percentile(replay, n, 0.5),
+           percentile(capture, n, 0.9), percentile(replay, n, 0.9),
+           percentile(capture, n, 0.99), percentile(replay, n, 0.99));
+}
+
+static void report(double capture_span, double replay_span, int verbose) {
+    static const uint16_t ops[] = { TFTP_OPCODE_RRQ, TFTP_OPCODE_WRQ };
+    double *cap_lat = malloc(num_flows * sizeof(double));
+    double *rep_lat = malloc(num_flows * sizeof(double));
+    double *cap_done = malloc(num_flows * sizeof(double));
+    double *rep_done = malloc(num_flows * sizeof(double));
+    if (!cap_lat || !rep_lat || !cap_done || !rep_done) {
+        perror("malloc");
+        exit(1);
+    }
+
+    if (verbose) {
+        printf("%-6s %-21s %-32s %12s %12s %12s %12s %s\n", "op", "client", "fichier",
+               "lat cap ms", "lat rej ms", "dur cap ms", "dur rej ms", "état");
+        for (size_t i = 0; i < num_flows; i++) {
+            Flow *f = flows[i];
+            struct in_addr addr = { .s_addr = f->client_ip };
+            char client[32];
+            snprintf(client, sizeof(client), "%s:%d", inet_ntoa(addr), ntohs(f->client_port));
+            printf("%-6s %-21s %-32.32s %12.3f %12.3f %12.3f %12.3f %s%s\n",
+                   f->opcode == TFTP_OPCODE_RRQ ? "RRQ" : "WRQ", client, f->filename,
+                   f->first_response >= 0 ? (f->first_response - f->start) * 1000.0 : -1.0,
+                   f->response_at > 0 ? f->response_at - f->request_at : -1.0,
+                   (f->end - f->start) * 1000.0, f->finished_at - f->request_at,
+                   f->state == FLOW_DONE ? "ok" : "échec", f->replay_error ? " (ERROR)" : "");
+        }
+        printf("\n");
+    }
+
+    printf("Comparaison capture / rejeu (ms)\n");
+    for (size_t k = 0; k < sizeof(ops) / sizeof(ops[0]); k++) {
+        size_t n_lat = 0, n_done = 0, count = 0, failed = 0, errors_cap = 0, errors_rep = 0;
+        size_t bytes_cap = 0, bytes_rep = 0;
+        for (size_t i = 0; i < num_flows; i++) {
+            Flow *f = flows[i];
+            if (f->opcode != ops[k]) continue;
+            count++;
+            failed += f->state == FLOW_FAILED;
+            errors_cap += f->capture_error;
+            errors_rep += f->replay_error;
+            bytes_cap += f->capture_bytes;
+            bytes_rep += f->bytes;
+            if (f->first_response >= 0 && f->response_at > 0) {
+                cap_lat[n_lat] = (f->first_response - f->start) * 1000.0;
+                rep_lat[n_lat++] = f->response_at - f->request_at;
+            }
+            if (f->state == FLOW_DONE && !f->capture_error && !f->replay_error) {
+                cap_done[n_done] = (f->end - f->start) * 1000.0;
+                rep_done[n_done++] = f->finished_at - f->request_at;
+            }
+        }
+        if (count == 0) continue;
+        printf("%s : %zu clients, %zu en échec au rejeu, ERROR capture/rejeu %zu / %zu, octets %zu / %zu\n",
+               ops[k] == TFTP_OPCODE_RRQ ? "RRQ" : "WRQ", count, failed, errors_cap, errors_rep, bytes_cap, bytes_rep);
+        report_series("  latence de réponse", cap_lat, rep_lat, n_lat);
+        report_series("  durée des transferts", cap_done, rep_done, n_done);
+    }
+
+    size_t total_cap = 0, total_rep = 0;
+    for (size_t i = 0; i < num_flows; i++) {
+        total_cap += flows[i]->capture_bytes;
+        total_rep += flows[i]->bytes;
+    }
+    printf("Débit global : capture %.1f Ko/s sur %.3f s, rejeu %.1f Ko/s sur %.3f s",
+           capture_span > 0 ? total_cap / capture_span / 1024.0 : 0.0, capture_span,
+           replay_span > 0 ? total_rep / (replay_span / 1000.0) / 1024.0 : 0.0, replay_span / 1000.0);
+    if (speed > 0) {
+        printf(" (vitesse x%g)\n", speed);
+    } else {
+        printf(" (sans délais)\n");
+    }
+
+    free(cap_lat);
+    free(rep_lat);
+    free(cap_done);
+    free(rep_done);
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [-s <vitesse>] [-t <IP serveur>] [-p <port serveur>] [-P <port TFTP dans la capture>] [-v] <capture.pcap>\n", prog);
+    printf("  -s  facteur d'accélération (1 = temps réel, 0 = sans délais), défaut 1\n");
+    printf("  -t  serveur à tester, défaut 127.0.0.1\n");
+    printf("  -p  port du serveur à tester, défaut 69\n");
+    printf("  -P  port du serveur dans la capture, défaut 69\n");
+    printf("  -v  détail par client\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *server_ip = "127.0.0.1";
+    int server_port = 69, capture_port = 69, verbose = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:t:p:P:vh")) != -1) {
+        switch (opt) {
+        case 's': speed = atof(optarg); break;
+        case 't': server_ip = optarg; break;
+        case 'p': server_port = atoi(optarg); break;
+        case 'P': capture_port = atoi(optarg); break;
+        case 'v': verbose = 1; break;
+        default:
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+    if (optind != argc - 1 || speed < 0) {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(server_port);
+    if (inet_pton(AF_INET, server_ip, &server_addr.sin_addr) <= 0) {
+        fprintf(stderr, "Adresse du serveur invalide : %s\n", server_ip);
+        exit(1);
+    }
+
+    long packets = load_pcap(argv[optind], (uint16_t)capture_port);
+    double capture_span = 0;
+    for (size_t i = 0; i < num_flows; i++) {
+        if (flows[i]->end > capture_span) capture_span = flows[i]->end;
+    }
+    printf("Capture : %ld paquets UDP, %zu clients TFTP sur %.3f s\n", packets, num_flows, capture_span);
+    if (num_flows == 0) {
+        return 0;
+    }
+
+    // Un socket par client rejoué
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    int epfd = epoll_create1(0);
+    if (epfd == -1) {
+        perror("epoll_create1");
+        exit(1);
+    }
+
+    double replay_start = now_ms();
+    for (size_t i = 0; i < num_flows; i++) {
+        flows[i]->peer = server_addr;
+        set_deadline(flows[i], replay_start + scaled(flows[i]->start));
+    }
+
+    struct epoll_event events[256];
+    uint8_t buffer[MAX_PACKET_SIZE];
+
+    while (finished_flows < num_flows) {
+        double now = now_ms();
+
+        // Actions et temporisations échues
+        while (num_timers > 0 && timers[0].time <= now) {
+            TimerEntry entry = timer_pop();
+            Flow *f = entry.flow;
+            if (f->state == FLOW_DONE || f->state == FLOW_FAILED) continue;
+            if (entry.time != f->deadline) continue;
+            if (f->state == FLOW_WAITING || f->action_pending) {
+                flow_action(f, epfd, now);
+            } else {
+                flow_timeout(f, now);
+            }
+        }
+
+        if (finished_flows == num_flows) break;
+
+        int timeout = -1;
+        if (num_timers > 0) {
+            double wait = timers[0].time - now_ms();
+            timeout = wait > 0 ? (int)wait + 1 : 0;
+        }
+        int n = epoll_wait(epfd, events, 256, timeout);
+        now = now_ms();
+        for (int i = 0; i < n; i++) {
+            Flow *f = events[i].data.ptr;
+            while (1) {
+                struct sockaddr_in from;
+                socklen_t from_len = sizeof(from);
+                ssize_t len = recvfrom(f->sock, buffer, sizeof(buffer), 0, (struct sockaddr *)&from, &from_len);
+                if (len < 0) break;
+                flow_receive(f, buffer, len, &from, now);
+            }
+            if (f->state == FLOW_DONE || f->state == FLOW_FAILED) {
+                epoll_ctl(epfd, EPOLL_CTL_DEL, f->sock, NULL);
+                close(f->sock);
+                f->sock = -1;
+            }
+        }
+    }
+
+    report(capture_span, now_ms() - replay_start, verbose);
+    close(epfd);
+    return 0;
+}
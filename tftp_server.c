@@ -1,203 +1,508 @@
+#define _GNU_SOURCE
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <arpa/inet.h>
-#include <sys/time.h>
-
-#define TFTP_OPCODE_RRQ 1
-#define TFTP_OPCODE_WRQ 2
-#define TFTP_OPCODE_DATA 3
-#define TFTP_OPCODE_ACK 4
-#define TFTP_OPCODE_ERR 5
-
-typedef struct {
-    uint16_t opcode;
-    char filename[512];
-    char mode[10]; // octet netascii
-} TFTP_Request;
-
-typedef struct {
-    uint16_t opcode;
-    uint16_t block_num;
-    char data[512];
-} TFTP_DataPacket;
-
-typedef struct {
-    uint16_t opcode;
-    uint16_t block_num;
-} TFTP_AckPacket;
-
-typedef struct {
-    uint16_t opcode;
-    uint16_t err_code;
-    char err_msg[512];
-} TFTP_ErrorPacket;
-
-
-#define TIMEOUT_SECONDS 1
-#define MAX_RETRIES 3
-
-#define MAX_PACKET_SIZE 516
-#define TFTP_DATA_PACKET_SIZE 516
-
-
-enum TFTPError {
-    NotDefined = 0,
-    FileNotFound = 1,
-    AccessViolation = 2,
-    DiskFullOrAllocationExceeded = 3,
-    IllegalOperation = 4,
-    UnknownTransferID = 5,
-    FileAlreadyExists = 6,
-    NoSuchUser = 7,
-    NUM_TFTP_ERRORS 
-};
-
-// Tableau de messages d'erreur correspondant aux codes d'erreur TFTP
-const char* TFTPErrorMessages[NUM_TFTP_ERRORS] = {
-    "Not defined, see error message (if any)",
-    "File not found",
-    "Access violation",
-    "Disk full or allocation exceeded",
-    "Illegal TFTP operation",
-    "Unknown transfer ID",
-    "File already exists",
-    "No such user"
-};
+#include <sys/epoll.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <stdarg.h>
+#include <pwd.h>
+#include <grp.h>
+#include <sys/stat.h>
+
+#include "tftp_packet.h"
+#include "tftp_cache.h"
+#include "tftp_writer.h"
+#include "tftp_readahead.h"
+#include "tftp_wheel.h"
+#include "tftp_session.h"
+#include "tftp_admission.h"
+#include "tftp_core.h"
+#include "tftp_relay.h"
+
+// Nombre maximum d'événements et de requêtes traités par tour de boucle
+#define MAX_EVENTS 256
+#define MAX_REQUESTS_PER_ROUND 64
+
+// Premier descripteur transmis par systemd (protocole LISTEN_FDS)
+#define SD_LISTEN_FDS_START 3
 
 typedef void (*TFTP_HandlerFunction)(int sockfd, struct sockaddr_in* client_addr, TFTP_Request* request);
 
 void handle_read_request(int sockfd, struct sockaddr_in* client_addr, TFTP_Request *request);
-void sendErrorPacket(int sockfd, struct sockaddr_in client_addr, uint16_t errorCode, const char *errorMsg);
 void handle_write_request(int sockfd, struct sockaddr_in* client_addr, TFTP_Request *request);
-const char* get_error_message(enum TFTPError error);
 
+static void session_receive(TFTP_Session *s);
+static void start_read_session(int sockfd, struct sockaddr_in *client_addr, TFTP_Request *request, TFTP_CacheEntry *file);
+static void start_write_session(int sockfd, struct sockaddr_in *client_addr, TFTP_Request *request);
+static void start_relay_session(int sockfd, struct sockaddr_in *client_addr, TFTP_Request *request);
+static void relay_wake(TFTP_Session *s);
+static void session_wake(void *owner);
+static void file_resolved(void *owner, TFTP_CacheEntry *file);
+static void serve_read_request(int sockfd, struct sockaddr_in *client_addr, TFTP_Request *request, TFTP_CacheEntry *file);
+
+// Les transferts sont des sessions pilotées par une boucle epoll : chaque
+// paquet reçu ou temporisation échue fait avancer une session d'une étape,
+// sans bloquer les autres. Les temporisations sont gérées par une roue.
+static int epfd;
+static TFTP_Wheel wheel;
+// Au-delà, les nouvelles requêtes attendent dans la file d'admission
+static size_t max_sessions = ADMISSION_DEFAULT_MAX_SESSIONS;
+// Marque des événements des téléchargements du relais dans la boucle
+static char relay_event;
+// Marque des événements inotify et des résolutions terminées du cache des fichiers servis
+static char cache_event;
+
+// RRQ dont le fichier, absent du cache, est ouvert en arrière-plan
+typedef struct {
+    int sockfd;
+    struct sockaddr_in client_addr;
+    TFTP_Request request;
+} TFTP_ReadLookup;
+// Marques des lectures anticipées et des écritures terminées qu'attendait une session
+static char readahead_event;
+static char writer_event;
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
+// Fonctions de la machine à états des sessions (tftp_core) : sockets,
+// fichiers et roue de temporisations du serveur
+static void core_send(void *ctx, TFTP_Session *s, const void *packet, size_t len);
+static ssize_t core_read(void *ctx, TFTP_Session *s, off_t offset, void *buf, size_t len);
+static int core_write(void *ctx, TFTP_Session *s, const void *data, size_t len, int last);
+static void core_arm(void *ctx, TFTP_Session *s, unsigned delay_ms);
+static void core_close(void *ctx, TFTP_Session *s);
+static void core_log(void *ctx, const char *fmt, va_list ap);
+
+static const TFTP_CoreOps core_ops = {
+    .ctx = NULL,
+    .send = core_send,
+    .read = core_read,
+    .write = core_write,
+    .arm = core_arm,
+    .close = core_close,
+    .log = core_log,
+};
 
 
-int main() {
-    int sockfd;
-    struct sockaddr_in server_addr, client_addr;
-    socklen_t client_len;
+void usage(const char *prog) {
+    printf("Usage: %s [-r <profondeur de lecture anticipée (1-%d chunks de %d Ko)>] [-m <mémoire de lecture anticipée (Mo)>]\n"
+           "          [-c <sessions simultanées (défaut %d)>] [-q <requêtes en attente (défaut %d)>] [-a <vieillissement (Mo/s, défaut %d)>]\n"
+           "          [-p <port (défaut 69)>] [-i (socket sur l'entrée standard, inetd)] [-u <utilisateur>] [-t <arrêt après inactivité (s)>]\n"
+           "          [-U <serveur amont (hôte[:port]), mode relais>] [-C <répertoire du cache (défaut %s)>] [-S <taille du cache (Mo, défaut %d)>]\n",
+           prog, READAHEAD_MAX_DEPTH, READAHEAD_CHUNK_SIZE / 1024,
+           ADMISSION_DEFAULT_MAX_SESSIONS, ADMISSION_DEFAULT_MAX_PENDING, ADMISSION_DEFAULT_AGING_RATE,
+           RELAY_DEFAULT_DIR, RELAY_DEFAULT_CACHE_MB);
+}
 
+// Mise en attente d'une requête quand toutes les sessions sont occupées ;
+// file pleine : erreur immédiate plutôt qu'un client qui expire
+static void queue_request(int sockfd, struct sockaddr_in *client_addr, TFTP_Request *request, TFTP_CacheEntry *file, off_t size) {
+    TFTP_Pending evicted;
+    int ret = admission_push(client_addr, request, file, size, now_ms(), &evicted);
+    if (ret != 0) {
+        // Refus de la nouvelle requête, ou de la requête évincée à sa place ;
+        // la nouvelle reste décrite par client_addr, request et size
+        struct sockaddr_in *refused_addr = ret == 1 ? &evicted.client_addr : client_addr;
+        TFTP_Request *refused = ret == 1 ? &evicted.request : request;
+        TFTP_CacheEntry *refused_file = ret == 1 ? evicted.file : file;
+        printf("[!] Serveur surchargé, requête refusée : %s\n", refused->filename);
+        sendErrorPacket(sockfd, *refused_addr, NotDefined, "Serveur surchargé, réessayez plus tard");
+        if (refused_file != NULL) {
+            cache_release(refused_file);
+        }
+        if (ret == -1) {
+            return;
+        }
+    }
+    printf("[ATTENTE] %s (%lld octets), %zu requête(s) en attente\n", request->filename, (long long)size, admission_count());
+}
 
-    // Création du socket
-    if ((sockfd = socket(AF_INET, SOCK_DGRAM, 0)) == -1) {
-        perror("Erreur lors de la création du socket");
-        exit(1);
+// Démarrage des requêtes en attente tant que des sessions sont disponibles
+static void admit_pending(int sockfd) {
+    TFTP_Pending p;
+    while (session_count() < max_sessions && admission_pop(&p) == 0) {
+        if (now_ms() - p.arrival > ADMISSION_MAX_WAIT_MS) {
+            // Le client a sans doute abandonné ; s'il attend encore, il le saura
+            printf("[!] Attente trop longue, requête abandonnée : %s\n", p.request.filename);
+            sendErrorPacket(sockfd, p.client_addr, NotDefined, "Délai d'attente dépassé, réessayez plus tard");
+            if (p.file != NULL) {
+                cache_release(p.file);
+            }
+            continue;
+        }
+        if (p.request.opcode == TFTP_OPCODE_RRQ && p.file == NULL) {
+            start_relay_session(sockfd, &p.client_addr, &p.request);
+        } else if (p.request.opcode == TFTP_OPCODE_RRQ) {
+            start_read_session(sockfd, &p.client_addr, &p.request, p.file);
+        } else {
+            start_write_session(sockfd, &p.client_addr, &p.request);
+        }
     }
+}
 
-    // Configuration de l'adresse du serveur
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    server_addr.sin_port = htons(69); // Port du serveur TFTP
+// Socket transmis par systemd (LISTEN_PID/LISTEN_FDS) ; -1 s'il n'y en a pas
+static int listen_fds_socket(void) {
+    const char *pid = getenv("LISTEN_PID");
+    const char *fds = getenv("LISTEN_FDS");
+    if (pid == NULL || fds == NULL || (pid_t)atol(pid) != getpid() || atoi(fds) < 1) {
+        return -1;
+    }
+    if (atoi(fds) > 1) {
+        printf("[!] %d sockets transmis, seul le premier est utilisé\n", atoi(fds));
+    }
+    // Les variables ne concernent que ce processus
+    unsetenv("LISTEN_PID");
+    unsetenv("LISTEN_FDS");
+    unsetenv("LISTEN_FDNAMES");
+    return SD_LISTEN_FDS_START;
+}
 
-    // Liaison du socket à l'adresse du serveur
-    if (bind(sockfd, (struct sockaddr*)&server_addr, sizeof(server_addr)) == -1) {
-        perror("Erreur lors de la liaison du socket");
-        exit(1);
+// Un socket hérité doit être un socket UDP IPv4 déjà lié ; il passe en non bloquant
+static int prepare_inherited_socket(int sockfd) {
+    int type;
+    socklen_t len = sizeof(type);
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+
+    if (getsockopt(sockfd, SOL_SOCKET, SO_TYPE, &type, &len) == -1 || type != SOCK_DGRAM ||
+        getsockname(sockfd, (struct sockaddr *)&addr, &addr_len) == -1 || addr.sin_family != AF_INET) {
+        fprintf(stderr, "Le descripteur %d n'est pas un socket UDP IPv4\n", sockfd);
+        return -1;
     }
+    int flags = fcntl(sockfd, F_GETFL);
+    if (flags == -1 || fcntl(sockfd, F_SETFL, flags | O_NONBLOCK) == -1 ||
+        fcntl(sockfd, F_SETFD, FD_CLOEXEC) == -1) {
+        perror("fcntl");
+        return -1;
+    }
+    return 0;
+}
 
-    printf("Serveur TFTP en attente de connexions (port 69)...\n");
+// inetd passe aussi le socket en sortie standard et d'erreur : les messages
+// du serveur partent vers /dev/null plutôt que sur le réseau
+static void detach_stdio_from_socket(void) {
+    int devnull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    for (int fd = STDOUT_FILENO; fd <= STDERR_FILENO && devnull != -1; fd++) {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISSOCK(st.st_mode)) {
+            dup2(devnull, fd);
+        }
+    }
+    if (devnull != -1) {
+        close(devnull);
+    }
+}
 
-    // Réception de la demande de lecture (RRQ)
-    
+// Abandon des droits root une fois le port 69 obtenu
+static int drop_privileges(const char *user) {
+    struct passwd *pw = getpwnam(user);
+    if (pw == NULL) {
+        fprintf(stderr, "Utilisateur inconnu : %s\n", user);
+        return -1;
+    }
+    if ((geteuid() == 0 && setgroups(0, NULL) == -1) || setgid(pw->pw_gid) == -1 || setuid(pw->pw_uid) == -1) {
+        perror("Erreur lors de l'abandon des privilèges");
+        return -1;
+    }
+    return 0;
+}
 
-   
+// Réception des requêtes en attente sur le port 69
+static void receive_requests(int sockfd) {
     TFTP_Request request;
-    client_len = sizeof(client_addr);
+    struct sockaddr_in client_addr;
     char buffer[MAX_PACKET_SIZE];
 
-    while (1){
+    for (int i = 0; i < MAX_REQUESTS_PER_ROUND; i++) {
+        socklen_t client_len = sizeof(client_addr);
         ssize_t num_bytes_received = recvfrom(sockfd, &buffer, MAX_PACKET_SIZE, 0, (struct sockaddr *)&client_addr, &client_len);
         if (num_bytes_received == -1) {
-            perror("Erreur lors de la réception de la demande");
-            continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                perror("Erreur lors de la réception de la demande");
+            }
+            return;
         }
 
         printf("Taille du paquet reçu: %zd octets\n", num_bytes_received);
-        memcpy(&request.opcode, buffer, sizeof(uint16_t));
-        TFTP_HandlerFunction selectedHandler = NULL;
 
+        // Extraction de l'opcode, du nom de fichier et du mode de transfert
+        const char *errorMsg;
+        if (parse_request(buffer, num_bytes_received, &request, &errorMsg) == -1) {
+            printf("Erreur: %s.\n", errorMsg);
+            // Envoyer un paquet d'erreur au client
+            sendErrorPacket(sockfd, client_addr, NotDefined, errorMsg);
+            continue;
+        }
+
+        // Requête retransmise par un client déjà en attente
+        if (admission_queued(&client_addr, &request)) {
+            continue;
+        }
 
         // Gestion de la demande en fonction de l'opcode
-        if (ntohs(request.opcode) == TFTP_OPCODE_RRQ) {
+        TFTP_HandlerFunction selectedHandler = NULL;
+        if (request.opcode == TFTP_OPCODE_RRQ) {
             selectedHandler = handle_read_request;
-        } else if (ntohs(request.opcode) == TFTP_OPCODE_WRQ) {
+        } else if (request.opcode == TFTP_OPCODE_WRQ) {
             selectedHandler = handle_write_request;
+        }
+
+        if (selectedHandler != NULL) {
+            selectedHandler(sockfd, &client_addr, &request);
         } else {
             // Opcode non pris en charge, envoi d'un paquet d'erreur au client
             sendErrorPacket(sockfd, client_addr, 0, "Opcode non pris en charge");
-            continue;
         }
+    }
+}
 
+int main(int argc, char *argv[]) {
+    int sockfd;
+    struct sockaddr_in server_addr;
+    int readahead_depth = READAHEAD_MAX_DEPTH;
+    size_t readahead_budget = READAHEAD_DEFAULT_BUDGET;
+    long max_pending = ADMISSION_DEFAULT_MAX_PENDING;
+    int aging_rate = ADMISSION_DEFAULT_AGING_RATE;
+    int inetd = 0;
+    const char *user = NULL;
+    long idle_seconds = 0;
+    const char *upstream = NULL;
+    const char *relay_dir = RELAY_DEFAULT_DIR;
+    long relay_cache_mb = RELAY_DEFAULT_CACHE_MB;
+    int port = 69;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r:m:c:q:a:p:iu:t:U:C:S:h")) != -1) {
+        switch (opt) {
+        case 'r':
+            readahead_depth = atoi(optarg);
+            break;
+        case 'm':
+            readahead_budget = (size_t)atol(optarg) * 1024 * 1024;
+            break;
+        case 'c':
+            max_sessions = (size_t)atol(optarg);
+            break;
+        case 'q':
+            max_pending = atol(optarg);
+            break;
+        case 'a':
+            aging_rate = atoi(optarg);
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'i':
+            inetd = 1;
+            break;
+        case 'u':
+            user = optarg;
+            break;
+        case 't':
+            idle_seconds = atol(optarg);
+            break;
+        case 'U':
+            upstream = optarg;
+            break;
+        case 'C':
+            relay_dir = optarg;
+            break;
+        case 'S':
+            relay_cache_mb = atol(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+    if (readahead_init(readahead_depth, readahead_budget, session_wake) == -1 || max_sessions == 0 || max_pending < 0 ||
+        aging_rate <= 0 || idle_seconds < 0 || relay_cache_mb < 0 || port <= 0 || port > 65535 || admission_init((size_t)max_pending, (unsigned)aging_rate) == -1) {
+        usage(argv[0]);
+        exit(1);
+    }
 
-       
+    // Socket du port 69 : hérité de inetd (entrée standard) ou de systemd,
+    // sinon créé ici (un port inférieur à 1024 demande les droits root)
+    if (inetd) {
+        sockfd = STDIN_FILENO;
+        detach_stdio_from_socket();
+    } else {
+        sockfd = listen_fds_socket();
+    }
+    if (sockfd != -1) {
+        if (prepare_inherited_socket(sockfd) == -1) {
+            exit(1);
+        }
+    } else {
+        // Création du socket
+        if ((sockfd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1) {
+            perror("Erreur lors de la création du socket");
+            exit(1);
+        }
 
-        // Extraction du nom de fichier
-        size_t filename_length = strlen(buffer + 2);
-        strcpy(request.filename, buffer + 2);
-        if (filename_length == 0) {
-            // Gestion de l'erreur : Nom de fichier vide
-            printf("Erreur: Nom de fichier vide.\n");
-            // Envoyer un paquet d'erreur au client
-            sendErrorPacket(sockfd, client_addr, NotDefined, "Nom de fichier vide");
-            continue;
+        // Configuration de l'adresse du serveur
+        memset(&server_addr, 0, sizeof(server_addr));
+        server_addr.sin_family = AF_INET;
+        server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        server_addr.sin_port = htons(port); // Port du serveur TFTP
+
+        // Liaison du socket à l'adresse du serveur
+        if (bind(sockfd, (struct sockaddr*)&server_addr, sizeof(server_addr)) == -1) {
+            perror("Erreur lors de la liaison du socket");
+            exit(1);
         }
-       
+    }
+    if (user != NULL && drop_privileges(user) == -1) {
+        exit(1);
+    }
 
-        // Extraction du mode de transfert
-        size_t mode_offset = 2 + filename_length + 1; // Offset pour accéder au début du mode
-        size_t mode_length = strlen(buffer + mode_offset);
+    // Mode relais : les fichiers absents sont demandés au serveur amont
+    if (upstream != NULL &&
+        relay_init(upstream, relay_dir, (uint64_t)relay_cache_mb * 1024 * 1024, relay_wake) == -1) {
+        usage(argv[0]);
+        exit(1);
+    }
 
-        strcpy(request.mode, buffer + mode_offset);
-        if (mode_length == 0 || (strcasecmp(request.mode, "netascii") != 0 && strcasecmp(request.mode, "octet") != 0) ) {
-            // Gestion de l'erreur : Mode de transfert non reconnu
-            printf("Erreur: Mode de transfert non reconnu.\n");
-            // Envoyer un paquet d'erreur au client
-            sendErrorPacket(sockfd, client_addr, NotDefined, "Mode de transfert non reconnu");
-            continue;
+    // La file d'attente, les sessions et les threads du cache, de lecture
+    // anticipée et d'écriture sont initialisés à la première requête qui en
+    // a besoin : le premier paquet est traité dès l'activation.
+
+    // Boucle d'événements : socket du port 69 (data.ptr NULL) et sockets des sessions
+    if ((epfd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+        perror("Erreur lors de la création de l'instance epoll");
+        exit(1);
+    }
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, sockfd, &ev) == -1) {
+        perror("epoll_ctl");
+        exit(1);
+    }
+    ev.data.ptr = &relay_event;
+    if (relay_enabled() && epoll_ctl(epfd, EPOLL_CTL_ADD, relay_fd(), &ev) == -1) {
+        perror("epoll_ctl");
+        exit(1);
+    }
+    ev.data.ptr = &cache_event;
+    if (cache_init(file_resolved) == -1 || epoll_ctl(epfd, EPOLL_CTL_ADD, cache_resolver_fd(), &ev) == -1) {
+        perror("Erreur lors de l'initialisation du cache");
+        exit(1);
+    }
+    if (cache_fd() != -1 && epoll_ctl(epfd, EPOLL_CTL_ADD, cache_fd(), &ev) == -1) {
+        perror("epoll_ctl");
+        exit(1);
+    }
+    ev.data.ptr = &readahead_event;
+    if (readahead_fd() != -1 && epoll_ctl(epfd, EPOLL_CTL_ADD, readahead_fd(), &ev) == -1) {
+        perror("epoll_ctl");
+        exit(1);
+    }
+    ev.data.ptr = &writer_event;
+    if (writer_init(session_wake) == -1 || epoll_ctl(epfd, EPOLL_CTL_ADD, writer_fd(), &ev) == -1) {
+        perror("Erreur lors de l'initialisation des threads d'écriture");
+        exit(1);
+    }
+    wheel_init(&wheel, now_ms());
+
+    socklen_t addr_len = sizeof(server_addr);
+    getsockname(sockfd, (struct sockaddr *)&server_addr, &addr_len);
+    printf("Serveur TFTP en attente de connexions (port %d)...\n", ntohs(server_addr.sin_port));
+
+    // Arrêt après idle_seconds sans session ni requête (-t) ; en activation
+    // par socket, le prochain paquet relance le serveur
+    uint64_t idle_ms = (uint64_t)idle_seconds * 1000;
+    uint64_t last_activity = now_ms();
+
+    struct epoll_event events[MAX_EVENTS];
+    while (1) {
+        int timeout = wheel_timeout(&wheel, now_ms());
+        int relay_wait = relay_timeout();
+        if (relay_wait != -1 && (timeout == -1 || relay_wait < timeout)) {
+            timeout = relay_wait;
         }
-        
-        if (selectedHandler != NULL) {
-            selectedHandler(sockfd, &client_addr, &request);
-        } else {
-            // Opcode non pris en charge, envoi d'un paquet d'erreur au client
-            sendErrorPacket(sockfd, client_addr, 0, "Opcode non pris en charge");
+        if (idle_ms > 0 && session_count() == 0 && admission_count() == 0 && cache_pending() == 0 && relay_wait == -1) {
+            uint64_t now = now_ms();
+            if (now - last_activity >= idle_ms) {
+                printf("Aucune activité depuis %ld s, arrêt du serveur\n", idle_seconds);
+                break;
+            }
+            if (timeout == -1 || last_activity + idle_ms - now < (uint64_t)timeout) {
+                timeout = (int)(last_activity + idle_ms - now);
+            }
+        }
+
+        int n = epoll_wait(epfd, events, MAX_EVENTS, timeout);
+        if (n == -1 && errno != EINTR) {
+            perror("epoll_wait");
+            exit(1);
+        }
+
+        int readahead_ready = 0, writer_ready = 0;
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.ptr == NULL) {
+                receive_requests(sockfd);
+            } else if (events[i].data.ptr == &relay_event) {
+                // Traité avec les échéances du relais, ci-dessous
+            } else if (events[i].data.ptr == &cache_event) {
+                // Fichiers modifiés (entrées invalidées, surveillances inutiles
+                // retirées) ou ouverts : les RRQ en attente continuent
+                cache_process();
+            } else if (events[i].data.ptr == &readahead_event) {
+                // Traités après les événements : un réveil peut fermer une session
+                // dont un événement suit dans ce tableau
+                readahead_ready = 1;
+            } else if (events[i].data.ptr == &writer_event) {
+                writer_ready = 1;
+            } else {
+                session_receive(events[i].data.ptr);
+            }
+        }
+
+        // Retransmissions et expirations échues
+        TFTP_Timer *timer;
+        uint64_t now = now_ms();
+        while ((timer = wheel_expired(&wheel, now)) != NULL) {
+            core_timeout(&core_ops, (TFTP_Session *)timer);
+        }
+
+        // Chunks lus et tampons écrits : envoi des blocs et des ACK qu'attendaient les sessions
+        if (readahead_ready) {
+            readahead_process();
+        }
+        if (writer_ready) {
+            writer_process();
+        }
+
+        // Données et échéances des téléchargements depuis le serveur amont
+        if (relay_enabled()) {
+            relay_process();
         }
 
+        // Sessions libérées pendant ce tour : admission des requêtes en attente
+        admit_pending(sockfd);
+        if (n > 0 || session_count() > 0) {
+            last_activity = now_ms();
+        }
     }
     close(sockfd);
     return 0;
 }
 
 
-void handle_read_request(int sockfd, struct sockaddr_in* client_addr, TFTP_Request *request) {
-    printf("[RRQ] @IP %s:%d, file: %s, Mode: %s\n", inet_ntoa(client_addr->sin_addr), ntohs(client_addr->sin_port), request->filename, request->mode);
-   
-    // Ouverture du fichier demandé
-    FILE *file;
-    if (strcasecmp(request->mode, "netascii") == 0) {
-        file = fopen(request->filename, "r");
-    } else if (strcasecmp(request->mode, "octet") == 0) {
-        file = fopen(request->filename, "rb");
-    }
-
-    if (file == NULL) {
-        printf("Erreur: fichier non trouvé\n");
-        // Envoi d'un paquet d'erreur au client
-        sendErrorPacket(sockfd, *client_addr,FileNotFound, "Fichier non trouvé");
-        return;
-    }
-
-    // Création de la nouvelle socket pour les données
+// Socket de données sur un port éphémère, enregistré dans la boucle d'événements
+static int open_data_socket(TFTP_Session *s) {
     int sockfd_data;
-    if ((sockfd_data = socket(AF_INET, SOCK_DGRAM, 0)) == -1) {
+    if ((sockfd_data = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1) {
         perror("Erreur lors de la création de la nouvelle socket pour les données");
-        exit(1);
+        return -1;
     }
 
     // Liaison de la nouvelle socket à un port éphémère
@@ -208,214 +513,300 @@ void handle_read_request(int sockfd, struct sockaddr_in* client_addr, TFTP_Reque
     server_addr_data.sin_port = htons(0); // Utilisation d'un port éphémère
     if (bind(sockfd_data, (struct sockaddr*)&server_addr_data, sizeof(server_addr_data)) == -1) {
         perror("Erreur lors de la liaison de la nouvelle socket");
-        exit(1);
+        close(sockfd_data);
+        return -1;
     }
 
-    // printf("[PORT] Nouveau port : %d\n", ntohs(server_addr_data.sin_port));
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = s };
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, sockfd_data, &ev) == -1) {
+        perror("epoll_ctl");
+        close(sockfd_data);
+        return -1;
+    }
+    s->sock = sockfd_data;
+    return 0;
+}
 
-    // Envoi des paquets de données
-    TFTP_DataPacket data_packet;
-    TFTP_AckPacket ack_packet;
+// Fin d'une session : libération de ses ressources et de sa temporisation
+static void session_close(TFTP_Session *s) {
+    wheel_cancel(&wheel, &s->timer);
+    if (s->sock != -1) {
+        close(s->sock);
+    }
+    readahead_free(s->readahead);
+    if (s->relay != NULL) {
+        relay_detach(s->relay, s);
+    }
+    if (s->file != NULL) {
+        cache_release(s->file);
+    }
+    writer_free(s->writer);
+    if (s->fd != -1) {
+        close(s->fd);
+    }
+    free(s->filename);
+    session_free(s);
+}
 
-    size_t num_bytes_read;
-    int block_num = 1;
-    
-    struct timeval tv;
-    tv.tv_sec = TIMEOUT_SECONDS;
-    tv.tv_usec = 0;
-    setsockopt(sockfd_data, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof tv);
+static TFTP_Session *session_new(uint8_t opcode, struct sockaddr_in *client_addr, const char *filename) {
+    TFTP_Session *s = session_alloc();
+    if (s == NULL) {
+        return NULL;
+    }
+    s->opcode = opcode;
+    s->peer = *client_addr;
+    s->filename = strdup(filename);
+    if (s->filename == NULL || open_data_socket(s) == -1) {
+        session_close(s);
+        return NULL;
+    }
+    return s;
+}
 
-    size_t total_bytes_sent = 0;
 
-    do {
-        num_bytes_read = fread(data_packet.data, 1, sizeof(data_packet.data), file);
-        if (num_bytes_read == -1) {
-            perror("Erreur lors de la lecture du fichier");
-            exit(EXIT_FAILURE);
-        }
+static void core_send(void *ctx, TFTP_Session *s, const void *packet, size_t len) {
+    (void)ctx;
+    // Une socket pleine équivaut à une perte : la retransmission s'en chargera
+    if (sendto(s->sock, packet, len, 0, (struct sockaddr*)&s->peer, sizeof(s->peer)) == -1
+        && errno != EAGAIN && errno != EWOULDBLOCK) {
+        perror("Erreur lors de l'envoi du paquet");
+    }
+}
 
-        data_packet.opcode = htons(TFTP_OPCODE_DATA);
-        data_packet.block_num = htons(block_num);
+static ssize_t core_read(void *ctx, TFTP_Session *s, off_t offset, void *buf, size_t len) {
+    (void)ctx;
+    if (s->readahead) {
+        return readahead_read(s->readahead, offset, buf, len);
+    }
+    return s->relay ? relay_read(s->relay, offset, buf, len) : pread(s->file->fd, buf, len, offset);
+}
+
+// Mise en file du bloc (attente seulement si la file est pleine) ; le dernier
+// bloc attend que le thread d'écriture ait tout écrit
+static int core_write(void *ctx, TFTP_Session *s, const void *data, size_t len, int last) {
+    (void)ctx;
+    int ret = writer_queue(s->writer, data, len);
+    if (ret != 0 || !last) {
+        return ret;
+    }
+    return writer_finish(s->writer);
+}
+
+static void core_arm(void *ctx, TFTP_Session *s, unsigned delay_ms) {
+    (void)ctx;
+    wheel_add(&wheel, &s->timer, now_ms() + delay_ms);
+}
+
+static void core_close(void *ctx, TFTP_Session *s) {
+    (void)ctx;
+    session_close(s);
+}
 
-        if (sendto(sockfd_data, &data_packet, num_bytes_read + 4, 0, (struct sockaddr*)client_addr, sizeof(*client_addr)) == -1) {
-            perror("Erreur lors de l'envoi du paquet de données");
-            exit(EXIT_FAILURE);
+static void core_log(void *ctx, const char *fmt, va_list ap) {
+    (void)ctx;
+    vprintf(fmt, ap);
+}
+
+
+void handle_read_request(int sockfd, struct sockaddr_in* client_addr, TFTP_Request *request) {
+    printf("[RRQ] @IP %s:%d, file: %s, Mode: %s\n", inet_ntoa(client_addr->sin_addr), ntohs(client_addr->sin_port), request->filename, request->mode);
+
+    // Fichiers du relais (partiels ou évincés à tout moment) : servis
+    // uniquement sous leur nom d'origine, via relay_open()
+    if (relay_enabled() && relay_in_cache(request->filename)) {
+        sendErrorPacket(sockfd, *client_addr, AccessViolation, "Accès refusé");
+        return;
+    }
+
+    // Résolution du fichier demandé via le cache (les recherches négatives
+    // répétées ne touchent pas le système de fichiers) ; absent du cache, il
+    // est ouvert en arrière-plan et la requête continue dans file_resolved()
+    TFTP_ReadLookup *lookup = malloc(sizeof(TFTP_ReadLookup));
+    if (lookup == NULL) {
+        sendErrorPacket(sockfd, *client_addr, NotDefined, "Erreur interne du serveur");
+        return;
+    }
+    lookup->sockfd = sockfd;
+    lookup->client_addr = *client_addr;
+    lookup->request = *request;
+    TFTP_CacheEntry *file = cache_lookup(request->filename, lookup);
+    if (file == NULL) {
+        if (errno != EINPROGRESS) {
+            free(lookup);
+            sendErrorPacket(sockfd, *client_addr, NotDefined, "Erreur interne du serveur");
         }
+        return;
+    }
+    free(lookup);
+    serve_read_request(sockfd, client_addr, request, file);
+}
 
-        printf("[DATA] Packet : %d (%zd Bytes) -> @IP %s:%d\n", block_num,num_bytes_read+4,inet_ntoa(client_addr->sin_addr), ntohs(client_addr->sin_port));
-
-
-        int retryCount = 0;
-        while (1) {
-            ssize_t recvlen = recvfrom(sockfd_data, &ack_packet, sizeof(ack_packet), 0, NULL, NULL);
-            if (recvlen > 0 && ack_packet.opcode == htons(TFTP_OPCODE_ACK) && ack_packet.block_num == htons(block_num)) {
-                printf("[ACK] Packet : %d <- @IP %s:%d\n", ntohs(ack_packet.block_num),inet_ntoa(client_addr->sin_addr), ntohs(client_addr->sin_port));
-                total_bytes_sent += num_bytes_read;
-                break; // ACK reçu
-            } else if (recvlen == -1) {
-                // Timeout, retransmission
-                if (retryCount < MAX_RETRIES) {
-                    printf("[TIMEOUT], retransmission du bloc %zd\n", block_num);
-                    sendto(sockfd_data, &data_packet, num_bytes_read + 4, 0, (struct sockaddr*)client_addr, sizeof(*client_addr));
-                    retryCount++;
-                } else {
-                    printf("[!] Nombre maximum de tentatives atteint, envoi d'un paquet d'erreur et abandon.\n");
-                    sendErrorPacket(sockfd, *client_addr,NotDefined, "Nombre maximum de tentatives atteint");
-                    fclose(file);
-                    close(sockfd_data);
-                    return;
-                }
-            }
+static void file_resolved(void *owner, TFTP_CacheEntry *file) {
+    TFTP_ReadLookup *lookup = owner;
+    serve_read_request(lookup->sockfd, &lookup->client_addr, &lookup->request, file);
+    free(lookup);
+}
+
+// Suite d'un RRQ une fois son fichier résolu
+static void serve_read_request(int sockfd, struct sockaddr_in *client_addr, TFTP_Request *request, TFTP_CacheEntry *file) {
+    // Fichier absent en mode relais : téléchargement depuis le serveur amont
+    // (taille inconnue, comme un WRQ pour la file d'attente)
+    if (file->fd == -1 && relay_enabled() && (file->err == ENOENT || file->err == ENOTDIR)) {
+        cache_release(file);
+        if (session_count() >= max_sessions || admission_count() > 0) {
+            queue_request(sockfd, client_addr, request, NULL, 0);
+            return;
         }
-        block_num++;
+        start_relay_session(sockfd, client_addr, request);
+        return;
+    }
 
+    if (file->fd == -1) {
+        printf("Erreur: fichier non trouvé\n");
+        // Envoi d'un paquet d'erreur au client
+        if (file->err == EACCES) {
+            sendErrorPacket(sockfd, *client_addr, AccessViolation, "Accès refusé");
+        } else {
+            sendErrorPacket(sockfd, *client_addr,FileNotFound, "Fichier non trouvé");
+        }
+        cache_release(file);
+        return;
+    }
 
-        
-    } while (num_bytes_read == sizeof(data_packet.data));
+    // Toutes les sessions occupées : attente, les petits fichiers en premier
+    if (session_count() >= max_sessions || admission_count() > 0) {
+        queue_request(sockfd, client_addr, request, file, file->size);
+        return;
+    }
+    start_read_session(sockfd, client_addr, request, file);
+}
 
+static void start_read_session(int sockfd, struct sockaddr_in *client_addr, TFTP_Request *request, TFTP_CacheEntry *file) {
+    TFTP_Session *s = session_new(TFTP_OPCODE_RRQ, client_addr, request->filename);
+    if (s == NULL) {
+        cache_release(file);
+        sendErrorPacket(sockfd, *client_addr, NotDefined, "Erreur interne du serveur");
+        return;
+    }
+    s->file = file;
 
-    printf("|->Transmission terminée avec succès. | file : %s (%zu):\n",request->filename, total_bytes_sent);
+    // Lecture anticipée en arrière-plan pour les gros fichiers (NULL : lecture directe)
+    s->readahead = readahead_new(file->fd, file->size, s);
 
-    // Fermeture du fichier et de la socket de données
-    fclose(file);
-    close(sockfd_data);
+    // Envoi du premier bloc ; les suivants partent à la réception de chaque ACK
+    core_start(&core_ops, s);
 }
 
+static void start_relay_session(int sockfd, struct sockaddr_in *client_addr, TFTP_Request *request) {
+    TFTP_Session *s = session_new(TFTP_OPCODE_RRQ, client_addr, request->filename);
+    if (s == NULL) {
+        sendErrorPacket(sockfd, *client_addr, NotDefined, "Erreur interne du serveur");
+        return;
+    }
+    if ((s->relay = relay_open(request->filename, s)) == NULL) {
+        if (errno == EINVAL) {
+            sendErrorPacket(s->sock, s->peer, AccessViolation, "Nom de fichier invalide");
+        } else {
+            sendErrorPacket(s->sock, s->peer, NotDefined, "Erreur interne du serveur");
+        }
+        session_close(s);
+        return;
+    }
 
+    // Fichier déjà en cache : lecture anticipée comme pour un fichier local ;
+    // sinon les blocs partent au fur et à mesure de leur arrivée (relay_wake)
+    off_t size;
+    int fd = relay_complete_fd(s->relay, &size);
+    if (fd != -1) {
+        s->readahead = readahead_new(fd, size, s);
+    }
+    core_start(&core_ops, s);
+}
+
+// Nouvelles données du serveur amont pour une session relayée, ou échec du
+// téléchargement (l'erreur du serveur amont est transmise au client)
+static void relay_wake(TFTP_Session *s) {
+    const char *message;
+    int code = relay_error(s->relay, &message);
+    if (code != -1) {
+        sendErrorPacket(s->sock, s->peer, code, message);
+        session_close(s);
+        return;
+    }
+    core_resume(&core_ops, s);
+}
 
+// Chunk attendu lu (RRQ) ou tampon d'écriture libéré (WRQ)
+static void session_wake(void *owner) {
+    core_resume(&core_ops, owner);
+}
 
 
 void handle_write_request(int sockfd, struct sockaddr_in* client_addr, TFTP_Request *request) {
     printf("[WRQ] @IP %s:%d, file: %s, Mode: %s\n", inet_ntoa(client_addr->sin_addr), ntohs(client_addr->sin_port), request->filename, request->mode);
 
+    if (relay_enabled() && relay_in_cache(request->filename)) {
+        sendErrorPacket(sockfd, *client_addr, AccessViolation, "Accès refusé");
+        return;
+    }
 
-    // Ouverture du fichier en écriture
-    FILE *file;
-    if (strcasecmp(request->mode, "netascii") == 0) {
-        file = fopen(request->filename, "w");
-    } else if (strcasecmp(request->mode, "octet") == 0) {
-        file = fopen(request->filename, "wb");
+    // Taille inconnue avant le transfert : un WRQ en attente passe en premier
+    if (session_count() >= max_sessions || admission_count() > 0) {
+        queue_request(sockfd, client_addr, request, NULL, 0);
+        return;
     }
+    start_write_session(sockfd, client_addr, request);
+}
 
-    if (file == NULL) {
+static void start_write_session(int sockfd, struct sockaddr_in *client_addr, TFTP_Request *request) {
+    // Ouverture du fichier en écriture ; les blocs reçus sont écrits par les
+    // threads d'écriture pour que l'ACK ne dépende pas de la latence du disque
+    int fd = open(request->filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
         printf("Erreur: impossible d'ouvrir le fichier en écriture\n");
         // Envoi d'un paquet d'erreur au client
         sendErrorPacket(sockfd, *client_addr, DiskFullOrAllocationExceeded, "Impossible d'ouvrir le fichier en écriture");
         return;
     }
 
-    // Création de la nouvelle socket pour les données
-    int sockfd_data;
-    if ((sockfd_data = socket(AF_INET, SOCK_DGRAM, 0)) == -1) {
-        perror("Erreur lors de la création de la nouvelle socket pour les données");
-        exit(1);
+    TFTP_Session *s = session_new(TFTP_OPCODE_WRQ, client_addr, request->filename);
+    if (s == NULL) {
+        close(fd);
+        sendErrorPacket(sockfd, *client_addr, NotDefined, "Erreur interne du serveur");
+        return;
     }
-
-    // Liaison de la nouvelle socket à un port éphémère
-    struct sockaddr_in server_addr_data;
-    memset(&server_addr_data, 0, sizeof(server_addr_data));
-    server_addr_data.sin_family = AF_INET;
-    server_addr_data.sin_addr.s_addr = htonl(INADDR_ANY);
-    server_addr_data.sin_port = htons(0); // Utilisation d'un port éphémère
-    if (bind(sockfd_data, (struct sockaddr*)&server_addr_data, sizeof(server_addr_data)) == -1) {
-        perror("Erreur lors de la liaison de la nouvelle socket à un port éphémère");
-        exit(1);
+    s->fd = fd;
+    if ((s->writer = writer_new(fd, s)) == NULL) {
+        sendErrorPacket(s->sock, s->peer, NotDefined, "Erreur interne du serveur");
+        session_close(s);
+        return;
     }
-
-    // printf("[PORT] Nouveau port : %d\n", ntohs(server_addr_data.sin_port));
+    s->windowsize = request->windowsize;
 
     // Envoi du premier ACK
-    TFTP_AckPacket ackPacket;
-    ackPacket.opcode = htons(TFTP_OPCODE_ACK);
-    ackPacket.block_num = htons(0);
-    sendto(sockfd_data, &ackPacket, sizeof(ackPacket), 0, (struct sockaddr*)client_addr, sizeof(*client_addr));
-
-    // Réception et écriture des paquets de données
-    int blockNumber = 1;
-
-    struct timeval tv;
-    tv.tv_sec = TIMEOUT_SECONDS;
-    tv.tv_usec = 0;
-    setsockopt(sockfd_data, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof tv);
-    int retryCount = 0;
+    core_start(&core_ops, s);
+}
 
-    size_t total_bytes_received = 0;
+// Paquets en attente sur le socket d'une session
+static void session_receive(TFTP_Session *s) {
+    char buffer[MAX_PACKET_SIZE];
+    struct sockaddr_in from;
 
     while (1) {
-        TFTP_DataPacket dataPacket;
-        ssize_t recvlen = recvfrom(sockfd_data, &dataPacket, sizeof(dataPacket), 0, NULL, NULL);
-
+        socklen_t from_len = sizeof(from);
+        ssize_t recvlen = recvfrom(s->sock, buffer, sizeof(buffer), 0, (struct sockaddr *)&from, &from_len);
         if (recvlen == -1) {
-            // Timeout, retransmission de l'ACK précédent
-            printf("Timeout, retransmission de l'ACK précédent\n");
-            if (retryCount < MAX_RETRIES) {
-                sendto(sockfd_data, &ackPacket, sizeof(ackPacket), 0, (struct sockaddr*)client_addr, sizeof(*client_addr));
-                retryCount++;
-                continue;
-            } else {
-                printf("Nombre maximum de tentatives atteint, abandon de la transmission.\n");
-                fclose(file);
-                close(sockfd_data);
-                return;
-            }
+            return;
         }
-        retryCount = 0;
 
-        if (dataPacket.opcode == htons(TFTP_OPCODE_DATA) && ntohs(dataPacket.block_num) == blockNumber-1) {
-            sendto(sockfd_data, &ackPacket, sizeof(ackPacket), 0, (struct sockaddr*)client_addr, sizeof(*client_addr));
+        // Paquet d'un autre TID que le client de la session
+        if (from.sin_addr.s_addr != s->peer.sin_addr.s_addr || from.sin_port != s->peer.sin_port) {
+            sendErrorPacket(s->sock, from, UnknownTransferID, "TID inconnu");
             continue;
         }
 
-        if (dataPacket.opcode == htons(TFTP_OPCODE_DATA) && ntohs(dataPacket.block_num) == blockNumber) {
-            total_bytes_received += recvlen - 4;
-            size_t bytesWritten = fwrite(dataPacket.data, 1, recvlen - 4, file);
-            if (bytesWritten < recvlen - 4) {
-                printf("Erreur lors de l'écriture dans le fichier\n");
-                // Envoi d'un paquet d'erreur au client
-                sendErrorPacket(sockfd_data, *client_addr, DiskFullOrAllocationExceeded, "Erreur lors de l'écriture dans le fichier");
-                fclose(file);
-                close(sockfd_data);
-                return;
-            }
-
-            // Envoi de l'ACK
-            ackPacket.block_num = dataPacket.block_num;
-            sendto(sockfd_data, &ackPacket, sizeof(ackPacket), 0, (struct sockaddr*)client_addr, sizeof(*client_addr));
-
-            if (recvlen < TFTP_DATA_PACKET_SIZE) {
-                // Dernier paquet reçu, fin de la transmission
-                break;
-            }
-            blockNumber++;
-        } else if (ntohs(dataPacket.opcode) == TFTP_OPCODE_ERR) {
-            printf("Erreur reçue du serveur : %s\n",dataPacket.data);
-            fclose(file);
-            return;
-        } else {
-            fclose(file);
-            close(sockfd_data);
-            sendErrorPacket(sockfd_data, *client_addr, NotDefined, "Paquet invalide reçu du serveur.");
+        if (core_input(&core_ops, s, buffer, recvlen) == -1) {
             return;
         }
     }
-    printf("|->Réception terminée avec succès. | file : %s (%zu):\n",request->filename, total_bytes_received);
-    // Fermeture du fichier et de la socket de données
-    fclose(file);
-    close(sockfd_data);
-}
-
-void sendErrorPacket(int sockfd, struct sockaddr_in client_addr, uint16_t errorCode, const char *errorMsg) {
-    TFTP_ErrorPacket errPacket;
-    errPacket.opcode = htons(TFTP_OPCODE_ERR);
-    errPacket.err_code = htons(errorCode);
-    strcpy(errPacket.err_msg, errorMsg);
-    sendto(sockfd, &errPacket, sizeof(errPacket), 0, (struct sockaddr*)&client_addr, sizeof(client_addr));
 }
-
-const char* get_error_message(enum TFTPError error) {
-    if (error >= 0 && error < NUM_TFTP_ERRORS) {
-        return TFTPErrorMessages[error];
-    } else {
-        return "Unknown error";
-    }
-}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "tftp_session.h"
+
+// Allocateur des sessions : blocs de SESSION_SLAB_SIZE sessions alignées sur
+// une ligne de cache, et liste des sessions libres chaînées par timer.next.
+
+_Static_assert(offsetof(TFTP_Session, peer) + sizeof(struct sockaddr_in) <= 64,
+               "les champs chauds de TFTP_Session doivent tenir dans une ligne de cache");
+
+static TFTP_Session *free_list;
+static size_t num_sessions;
+
+static int grow(void) {
+    TFTP_Session *slab = aligned_alloc(64, SESSION_SLAB_SIZE * sizeof(TFTP_Session));
+    if (slab == NULL) {
+        return -1;
+    }
+    for (int i = SESSION_SLAB_SIZE - 1; i >= 0; i--) {
+        slab[i].timer.next = (TFTP_Timer *)free_list;
+        free_list = &slab[i];
+    }
+    return 0;
+}
+
+TFTP_Session *session_alloc(void) {
+    if (free_list == NULL && grow() == -1) {
+        return NULL;
+    }
+    TFTP_Session *s = free_list;
+    free_list = (TFTP_Session *)s->timer.next;
+    memset(s, 0, sizeof(*s));
+    s->sock = -1;
+    s->fd = -1;
+    num_sessions++;
+    return s;
+}
+
+void session_free(TFTP_Session *s) {
+    free(s->reorder);
+    s->timer.next = (TFTP_Timer *)free_list;
+    free_list = s;
+    num_sessions--;
+}
+
+size_t session_count(void) {
+    return num_sessions;
+}
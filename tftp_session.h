@@ -0,0 +1,48 @@
+#ifndef TFTP_SESSION_H
+#define TFTP_SESSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+
+#include "tftp_wheel.h"
+#include "tftp_cache.h"
+#include "tftp_writer.h"
+#include "tftp_readahead.h"
+
+// Sessions allouées par blocs de SESSION_SLAB_SIZE, jamais rendus au système
+#define SESSION_SLAB_SIZE 256
+
+// État d'un transfert en cours. La première ligne de cache contient tout ce
+// que touche le traitement d'un paquet ou d'une temporisation ; une session
+// inactive ne coûte que cette structure et son socket, plus pour un WRQ son
+// writer (sans tampon avant le premier bloc, puis au plus un tampon partiel).
+typedef struct TFTP_Session {
+    // --- Ligne de cache chaude ---
+    _Alignas(64) TFTP_Timer timer; // retransmission / expiration (premier membre)
+    int sock;                      // socket de données (TID du serveur)
+    uint8_t opcode;                // TFTP_OPCODE_RRQ ou TFTP_OPCODE_WRQ
+    uint8_t retries;
+    uint8_t waiting;               // RRQ : bloc seq pas encore lu ; WRQ : ACK retardé par l'écriture
+    uint8_t done;                  // WRQ : dernier bloc acquitté, session gardée CORE_DALLY_MS
+    uint16_t last_len;             // taille des données du bloc en cours (envoyé ou reçu)
+    uint32_t seq;                  // RRQ : bloc envoyé ; WRQ : bloc attendu (numéro sur 16 bits = seq & 0xFFFF)
+    struct sockaddr_in peer;       // TID du client
+
+    // --- Champs froids ---
+    TFTP_CacheEntry *file;         // RRQ
+    TFTP_ReadAhead *readahead;     // RRQ, NULL pour les petits fichiers
+    struct TFTP_RelayFile *relay;  // RRQ relayé (fichier du cache du relais)
+    TFTP_Writer *writer;           // WRQ
+    int fd;                        // WRQ
+    uint16_t windowsize;           // WRQ : option windowsize acceptée (OACK au lieu de l'ACK 0), 0 sinon
+    struct TFTP_Reorder *reorder;  // WRQ fenêtré : blocs reçus en avance (tftp_core), NULL sans trou
+    size_t bytes;
+    char *filename;
+} TFTP_Session;
+
+TFTP_Session *session_alloc(void);
+void session_free(TFTP_Session *s);
+size_t session_count(void);
+
+#endif
@@ -0,0 +1,706 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "libtftp.h"
+#include "tftp_packet.h"
+#include "tftp_session.h"
+#include "tftp_core.h"
+
+// Simulateur de transferts TFTP. Le client (libtftp) et les sessions du
+// serveur (tftp_core) tournent sans socket ni horloge réelle : leurs paquets
+// passent par un réseau simulé (débit, délai, gigue et pertes tirés d'un
+// générateur à graine) et le temps est virtuel. Un scénario se déroule donc
+// en quelques microsecondes à quelques millisecondes, et deux exécutions
+// avec la même graine donnent exactement les mêmes résultats.
+//
+// La suite de scénarios (sens, taille, pertes, profil réseau, graine) est
+// écrite en CSV : temps de transfert, débit utile et efficacité des
+// retransmissions. Avec -b, les résultats sont comparés à un CSV de
+// référence et toute régression fait échouer la commande : les échecs déjà
+// présents dans la référence (fortes pertes) sont attendus, seul un scénario
+// qui réussissait et échoue, ou qui ralentit, est signalé. sim_reference.csv
+// est la référence de `make sim` ; elle est régénérée (`make sim-reference`)
+// avec les changements qui améliorent les résultats.
+
+#define SIM_CLIENT_PORT 40000
+#define SIM_SERVER_PORT 69
+#define SIM_SESSION_PORT 50000
+#define SIM_MAX_SESSIONS 16
+// Un scénario qui dépasse ce temps virtuel est arrêté (boucle de retransmissions)
+#define SIM_TIME_LIMIT_US (3600ULL * 1000000)
+
+typedef struct {
+    const char *name;
+    unsigned delay_ms;   // délai de propagation dans chaque sens
+    unsigned jitter_ms;  // gigue uniforme ajoutée au délai (peut réordonner)
+    unsigned rate_kbps;  // débit de chaque sens du lien
+} NetProfile;
+
+static const NetProfile profiles[] = {
+    { "lan", 1, 0, 100000 },
+    { "wan", 20, 5, 10000 },
+    { "lointain", 100, 30, 2000 },
+};
+static const size_t sizes[] = { 0, 512, 3000, 65536, 300000 };
+static const double losses[] = { 0.0, 0.01, 0.05, 0.10, 0.20 };
+
+#define NUM_PROFILES (sizeof(profiles) / sizeof(profiles[0]))
+#define NUM_SIZES (sizeof(sizes) / sizeof(sizes[0]))
+#define NUM_LOSSES (sizeof(losses) / sizeof(losses[0]))
+
+typedef struct {
+    int id;
+    TFTP_Direction direction;
+    size_t size;
+    double loss;
+    const NetProfile *net;
+    uint64_t seed;
+} Scenario;
+
+typedef enum { RESULT_OK, RESULT_FAILED, RESULT_CORRUPT } ResultStatus;
+static const char *status_names[] = { "ok", "echec", "corrompu" };
+
+typedef struct {
+    ResultStatus status;
+    double time_ms;         // temps virtuel jusqu'à la fin du transfert côté client
+    double goodput_kbps;    // données utiles / temps
+    unsigned long data_sent; // paquets DATA émis par l'expéditeur, retransmissions comprises
+    double efficiency;      // blocs utiles / paquets DATA émis
+    unsigned long packets, lost;
+} Result;
+
+typedef struct SimPacket {
+    struct SimPacket *next; // liste des paquets libres
+    uint64_t time;   // arrivée (µs virtuelles)
+    uint64_t order;  // ordre d'émission, départage les arrivées simultanées
+    struct sockaddr_in from, to;
+    uint16_t len;
+    uint8_t data[MAX_PACKET_SIZE];
+} SimPacket;
+
+// État du réseau simulé pendant un scénario
+typedef struct {
+    const Scenario *sc;
+    uint64_t now;               // µs virtuelles
+    uint64_t rng;
+    uint64_t link_free[2];      // fin d'émission en cours : 0 vers le serveur, 1 vers le client
+    uint64_t order;
+
+    SimPacket **heap;           // paquets en vol, tas ordonné par arrivée
+    size_t heap_size, heap_capacity;
+    SimPacket *free_packets;    // réutilisés d'un scénario à l'autre
+
+    struct sockaddr_in client_addr, server_addr;
+    TFTP_Transfer *client;
+    TFTP_Session *sessions[SIM_MAX_SESSIONS];
+    size_t num_sessions;
+    uint16_t next_port;
+
+    const uint8_t *file;        // contenu envoyé
+    uint8_t *received;          // contenu reçu (client pour un get, serveur pour un put)
+    size_t received_len, capacity, read_pos;
+
+    unsigned long packets, lost, data_sent;
+    int verbose;
+} Sim;
+
+static TFTP_CoreOps server_ops;
+
+// ---- Générateur pseudo-aléatoire (splitmix64) ----
+
+static uint64_t rng_next(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static double rng_uniform(uint64_t *state) {
+    return (rng_next(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// ---- Paquets en vol ----
+
+static int packet_before(const SimPacket *a, const SimPacket *b) {
+    return a->time < b->time || (a->time == b->time && a->order < b->order);
+}
+
+static int heap_push(Sim *sim, SimPacket *p) {
+    if (sim->heap_size == sim->heap_capacity) {
+        size_t capacity = sim->heap_capacity ? sim->heap_capacity * 2 : 256;
+        SimPacket **heap = realloc(sim->heap, capacity * sizeof(*heap));
+        if (heap == NULL) {
+            return -1;
+        }
+        sim->heap = heap;
+        sim->heap_capacity = capacity;
+    }
+    size_t i = sim->heap_size++;
+    while (i > 0 && packet_before(p, sim->heap[(i - 1) / 2])) {
+        sim->heap[i] = sim->heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    sim->heap[i] = p;
+    return 0;
+}
+
+static SimPacket *heap_pop(Sim *sim) {
+    SimPacket *top = sim->heap[0];
+    SimPacket *last = sim->heap[--sim->heap_size];
+    size_t i = 0;
+    while (2 * i + 1 < sim->heap_size) {
+        size_t child = 2 * i + 1;
+        if (child + 1 < sim->heap_size && packet_before(sim->heap[child + 1], sim->heap[child])) {
+            child++;
+        }
+        if (!packet_before(sim->heap[child], last)) {
+            break;
+        }
+        sim->heap[i] = sim->heap[child];
+        i = child;
+    }
+    if (sim->heap_size > 0) {
+        sim->heap[i] = last;
+    }
+    return top;
+}
+
+static void packet_release(Sim *sim, SimPacket *p) {
+    p->next = sim->free_packets;
+    sim->free_packets = p;
+}
+
+// Émission d'un paquet : perte éventuelle, sérialisation sur le lien, puis
+// propagation avec gigue. Retourne -1 (ENOBUFS) seulement si la mémoire manque.
+static int transmit(Sim *sim, const struct sockaddr_in *from, const struct sockaddr_in *to, const void *packet, size_t len) {
+    sim->packets++;
+    if (len >= 2 && ntohs(*(const uint16_t *)packet) == TFTP_OPCODE_DATA) {
+        sim->data_sent++;
+    }
+    if (rng_uniform(&sim->rng) < sim->sc->loss) {
+        sim->lost++;
+        return 0;
+    }
+
+    SimPacket *p = sim->free_packets;
+    if (p != NULL) {
+        sim->free_packets = p->next;
+    } else if ((p = malloc(sizeof(SimPacket))) == NULL) {
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    const NetProfile *net = sim->sc->net;
+    int dir = to->sin_port == sim->client_addr.sin_port;
+    uint64_t start = sim->link_free[dir] > sim->now ? sim->link_free[dir] : sim->now;
+    sim->link_free[dir] = start + (uint64_t)len * 8000 / net->rate_kbps;
+    p->time = sim->link_free[dir] + net->delay_ms * 1000ULL;
+    if (net->jitter_ms > 0) {
+        p->time += (uint64_t)(rng_uniform(&sim->rng) * net->jitter_ms * 1000);
+    }
+    p->order = sim->order++;
+    p->from = *from;
+    p->to = *to;
+    p->len = (uint16_t)len;
+    memcpy(p->data, packet, len);
+    if (heap_push(sim, p) == -1) {
+        packet_release(sim, p);
+        errno = ENOBUFS;
+        return -1;
+    }
+    return 0;
+}
+
+static void sim_log(Sim *sim, const char *fmt, va_list ap) {
+    if (!sim->verbose) {
+        return;
+    }
+    fprintf(stderr, "[%10.3f ms] ", sim->now / 1000.0);
+    vfprintf(stderr, fmt, ap);
+}
+
+// ---- Client : libtftp sur le réseau simulé ----
+
+static ssize_t client_send(void *net, const void *packet, size_t len, const struct sockaddr_in *to) {
+    Sim *sim = net;
+    return transmit(sim, &sim->client_addr, to, packet, len) == -1 ? -1 : (ssize_t)len;
+}
+
+static double client_clock(void *net) {
+    return ((Sim *)net)->now / 1000.0;
+}
+
+static ssize_t client_read(void *io, void *buf, size_t len) {
+    Sim *sim = io;
+    size_t remaining = sim->sc->size - sim->read_pos;
+    if (len > remaining) {
+        len = remaining;
+    }
+    memcpy(buf, sim->file + sim->read_pos, len);
+    sim->read_pos += len;
+    return len;
+}
+
+// Écriture des données reçues (client d'un get ou session d'un put)
+static int store(Sim *sim, const void *data, size_t len) {
+    if (sim->received_len + len > sim->capacity) {
+        errno = ENOSPC;
+        return -1;
+    }
+    memcpy(sim->received + sim->received_len, data, len);
+    sim->received_len += len;
+    return 0;
+}
+
+static ssize_t client_write(void *io, const void *buf, size_t len) {
+    return store(io, buf, len) == -1 ? -1 : (ssize_t)len;
+}
+
+static void client_log(TFTP_Transfer *t, const char *message, void *user) {
+    (void)t;
+    Sim *sim = user;
+    if (sim->verbose) {
+        fprintf(stderr, "[%10.3f ms] client : %s\n", sim->now / 1000.0, message);
+    }
+}
+
+// ---- Serveur : sessions tftp_core sur le réseau simulé ----
+// Le socket d'une session est son port sur le serveur simulé.
+
+static void server_send(void *ctx, TFTP_Session *s, const void *packet, size_t len) {
+    Sim *sim = ctx;
+    struct sockaddr_in from = sim->server_addr;
+    from.sin_port = htons((uint16_t)s->sock);
+    transmit(sim, &from, &s->peer, packet, len);
+}
+
+static ssize_t server_read(void *ctx, TFTP_Session *s, off_t offset, void *buf, size_t len) {
+    (void)s;
+    Sim *sim = ctx;
+    if ((size_t)offset >= sim->sc->size) {
+        return 0;
+    }
+    if (len > sim->sc->size - offset) {
+        len = sim->sc->size - offset;
+    }
+    memcpy(buf, sim->file + offset, len);
+    return len;
+}
+
+static int server_write(void *ctx, TFTP_Session *s, const void *data, size_t len, int last) {
+    (void)s;
+    (void)last;
+    return store(ctx, data, len);
+}
+
+// Le temps de la temporisation est porté par timer.expires (µs virtuelles)
+static void server_arm(void *ctx, TFTP_Session *s, unsigned delay_ms) {
+    s->timer.expires = ((Sim *)ctx)->now + delay_ms * 1000ULL;
+}
+
+static void server_close(void *ctx, TFTP_Session *s) {
+    Sim *sim = ctx;
+    for (size_t i = 0; i < sim->num_sessions; i++) {
+        if (sim->sessions[i] == s) {
+            sim->sessions[i] = sim->sessions[--sim->num_sessions];
+            break;
+        }
+    }
+    session_free(s);
+}
+
+static void server_log(void *ctx, const char *fmt, va_list ap) {
+    sim_log(ctx, fmt, ap);
+}
+
+static TFTP_CoreOps server_ops = {
+    .send = server_send,
+    .read = server_read,
+    .write = server_write,
+    .arm = server_arm,
+    .close = server_close,
+    .log = server_log,
+};
+
+// Requête reçue sur le port 69 : une session par requête, comme le serveur
+// (une requête retransmise ouvre donc une seconde session)
+static void server_request(Sim *sim, const SimPacket *p) {
+    TFTP_Request request;
+    TFTP_ErrorPacket err;
+    const char *errorMsg;
+
+    if (parse_request((const char *)p->data, p->len, &request, &errorMsg) == -1 ||
+        sim->num_sessions == SIM_MAX_SESSIONS) {
+        size_t len = build_error_packet(&err, NotDefined, errorMsg ? errorMsg : "Serveur surchargé");
+        transmit(sim, &sim->server_addr, &p->from, &err, len);
+        return;
+    }
+    TFTP_Session *s = session_alloc();
+    if (s == NULL) {
+        return;
+    }
+    s->opcode = (uint8_t)request.opcode;
+    s->peer = p->from;
+    s->sock = sim->next_port++;
+    s->filename = "sim";
+    if (s->opcode == TFTP_OPCODE_WRQ) {
+        s->windowsize = request.windowsize;
+    }
+    sim->sessions[sim->num_sessions++] = s;
+    core_start(&server_ops, s);
+}
+
+static void deliver(Sim *sim, const SimPacket *p) {
+    uint16_t port = ntohs(p->to.sin_port);
+
+    if (port == SIM_CLIENT_PORT) {
+        if (tftp_transfer_input(sim->client, p->data, p->len, &p->from) == LIBTFTP_RUNNING) {
+            tftp_transfer_tick(sim->client);
+        }
+        return;
+    }
+    if (port == SIM_SERVER_PORT) {
+        server_request(sim, p);
+        return;
+    }
+    for (size_t i = 0; i < sim->num_sessions; i++) {
+        TFTP_Session *s = sim->sessions[i];
+        if (s->sock != port) {
+            continue;
+        }
+        if (p->from.sin_port != s->peer.sin_port) {
+            TFTP_ErrorPacket err;
+            size_t len = build_error_packet(&err, UnknownTransferID, "TID inconnu");
+            server_send(sim, s, &err, len);
+        } else {
+            core_input(&server_ops, s, p->data, p->len);
+        }
+        return;
+    }
+    // Session terminée : le paquet est perdu
+}
+
+// ---- Déroulement d'un scénario ----
+
+static int run_scenario(Sim *sim, const Scenario *sc, const uint8_t *file, Result *result) {
+    sim->sc = sc;
+    sim->now = 0;
+    sim->rng = sc->seed;
+    sim->link_free[0] = sim->link_free[1] = 0;
+    sim->order = 0;
+    sim->num_sessions = 0;
+    sim->next_port = SIM_SESSION_PORT;
+    sim->file = file;
+    sim->received_len = 0;
+    sim->read_pos = 0;
+    sim->packets = sim->lost = sim->data_sent = 0;
+    server_ops.ctx = sim;
+
+    TFTP_Options options;
+    memset(&options, 0, sizeof(options));
+    options.direction = sc->direction;
+    options.server = sim->server_addr;
+    options.remote_filename = "sim";
+    options.transfer_mode = "octet";
+    options.read = client_read;
+    options.write = client_write;
+    options.io = sim;
+    options.on_log = client_log;
+    options.user = sim;
+    options.send = client_send;
+    options.clock = client_clock;
+    options.net = sim;
+    if ((sim->client = tftp_transfer_new(&options)) == NULL) {
+        return -1;
+    }
+
+    // Prochain événement : arrivée d'un paquet, échéance du client ou d'une session
+    while (1) {
+        uint64_t next = UINT64_MAX;
+        if (sim->heap_size > 0) {
+            next = sim->heap[0]->time;
+        }
+        int timeout = tftp_transfer_timeout(sim->client);
+        uint64_t client_wake = timeout >= 0 ? sim->now + timeout * 1000ULL : UINT64_MAX;
+        if (client_wake < next) {
+            next = client_wake;
+        }
+        for (size_t i = 0; i < sim->num_sessions; i++) {
+            if (sim->sessions[i]->timer.expires < next) {
+                next = sim->sessions[i]->timer.expires;
+            }
+        }
+        if (next == UINT64_MAX || next > SIM_TIME_LIMIT_US) {
+            break;
+        }
+        sim->now = next;
+
+        while (sim->heap_size > 0 && sim->heap[0]->time <= sim->now) {
+            SimPacket *p = heap_pop(sim);
+            deliver(sim, p);
+            packet_release(sim, p);
+        }
+        if (client_wake <= sim->now && tftp_transfer_status(sim->client) == LIBTFTP_RUNNING) {
+            tftp_transfer_tick(sim->client);
+        }
+        // Parcours à rebours : une session fermée est remplacée par la dernière, déjà vue
+        for (size_t i = sim->num_sessions; i-- > 0;) {
+            if (i < sim->num_sessions && sim->sessions[i]->timer.expires <= sim->now) {
+                core_timeout(&server_ops, sim->sessions[i]);
+            }
+        }
+    }
+
+    // Nettoyage d'un scénario interrompu par la limite de temps
+    while (sim->heap_size > 0) {
+        packet_release(sim, heap_pop(sim));
+    }
+    while (sim->num_sessions > 0) {
+        server_close(sim, sim->sessions[0]);
+    }
+
+    int status = tftp_transfer_status(sim->client);
+    const TFTP_Stats *stats = tftp_transfer_stats(sim->client);
+    unsigned long blocks = sc->size / LIBTFTP_BLOCK_SIZE + 1;
+
+    if (status != LIBTFTP_DONE) {
+        result->status = RESULT_FAILED;
+    } else if (sim->received_len != sc->size || memcmp(sim->received, file, sc->size) != 0) {
+        result->status = RESULT_CORRUPT;
+    } else {
+        result->status = RESULT_OK;
+    }
+    result->time_ms = stats->elapsed_ms;
+    result->goodput_kbps = result->status == RESULT_OK && stats->elapsed_ms > 0
+        ? sc->size * 8 / stats->elapsed_ms : 0;
+    result->data_sent = sim->data_sent;
+    result->efficiency = sim->data_sent > 0 ? (double)blocks / sim->data_sent : 0;
+    if (result->efficiency > 1) {
+        result->efficiency = 1; // transfert interrompu avant la fin
+    }
+    result->packets = sim->packets;
+    result->lost = sim->lost;
+
+    tftp_transfer_free(sim->client);
+    sim->client = NULL;
+    return 0;
+}
+
+// ---- Suite de scénarios et comparaison à une référence ----
+
+static size_t build_suite(Scenario *suite, int seeds, uint64_t base_seed) {
+    size_t n = 0;
+    for (int dir = 0; dir < 2; dir++) {
+        for (size_t p = 0; p < NUM_PROFILES; p++) {
+            for (size_t l = 0; l < NUM_LOSSES; l++) {
+                for (size_t z = 0; z < NUM_SIZES; z++) {
+                    for (int k = 0; k < seeds; k++) {
+                        Scenario *sc = &suite[n];
+                        sc->id = (int)n;
+                        sc->direction = dir == 0 ? TFTP_GET : TFTP_PUT;
+                        sc->size = sizes[z];
+                        sc->loss = losses[l];
+                        sc->net = &profiles[p];
+                        uint64_t state = base_seed * 0x100000001B3ULL + n;
+                        sc->seed = rng_next(&state);
+                        n++;
+                    }
+                }
+            }
+        }
+    }
+    return n;
+}
+
+static void print_header(FILE *out) {
+    fprintf(out, "id,sens,taille,pertes,reseau,statut,temps_ms,debit_kbps,data_envoyes,efficacite,paquets,perdus\n");
+}
+
+static void print_result(FILE *out, const Scenario *sc, const Result *r) {
+    fprintf(out, "%d,%s,%zu,%.2f,%s,%s,%.3f,%.1f,%lu,%.4f,%lu,%lu\n",
+            sc->id, sc->direction == TFTP_GET ? "get" : "put", sc->size, sc->loss, sc->net->name,
+            status_names[r->status], r->time_ms, r->goodput_kbps, r->data_sent, r->efficiency, r->packets, r->lost);
+}
+
+// Comparaison à un CSV de référence produit par la même suite : un scénario
+// qui échoue alors qu'il réussissait, ou dont le temps augmente de plus de
+// tolerance %, est une régression ; un échec déjà dans la référence est
+// attendu. Retourne le nombre de régressions.
+static int compare_baseline(const char *path, const Scenario *suite, const Result *results, size_t n, double tolerance) {
+    FILE *in = fopen(path, "r");
+    if (in == NULL) {
+        fprintf(stderr, "Impossible d'ouvrir la référence %s : %s\n", path, strerror(errno));
+        return -1;
+    }
+    char line[512];
+    int regressions = 0, improvements = 0, expected = 0;
+    size_t compared = 0;
+
+    if (fgets(line, sizeof(line), in) == NULL) {
+        fclose(in);
+        return 0;
+    }
+    while (fgets(line, sizeof(line), in) != NULL) {
+        int id;
+        char status[16];
+        double time_ms;
+        if (sscanf(line, "%d,%*[^,],%*[^,],%*[^,],%*[^,],%15[^,],%lf", &id, status, &time_ms) != 3 ||
+            id < 0 || (size_t)id >= n) {
+            continue;
+        }
+        const Result *r = &results[id];
+        int was_ok = strcmp(status, status_names[RESULT_OK]) == 0;
+        compared++;
+
+        if (r->status == RESULT_CORRUPT || (was_ok && r->status != RESULT_OK)) {
+            regressions++;
+            fprintf(stderr, "[REGRESSION] scénario %d : %s -> %s\n", id, status, status_names[r->status]);
+        } else if (was_ok && r->time_ms > time_ms * (1 + tolerance / 100)) {
+            regressions++;
+            fprintf(stderr, "[REGRESSION] scénario %d (%s, %zu octets, pertes %.2f, %s) : %.1f ms -> %.1f ms\n",
+                    id, suite[id].direction == TFTP_GET ? "get" : "put", suite[id].size, suite[id].loss,
+                    suite[id].net->name, time_ms, r->time_ms);
+        } else if ((!was_ok && r->status == RESULT_OK) || r->time_ms < time_ms * (1 - tolerance / 100)) {
+            improvements++;
+        }
+        if (!was_ok && r->status == RESULT_FAILED) {
+            expected++;
+        }
+    }
+    fclose(in);
+    fprintf(stderr, "Référence %s : %zu scénarios comparés, %d échec(s) attendu(s), %d régression(s), %d amélioration(s)\n",
+            path, compared, expected, regressions, improvements);
+    return regressions;
+}
+
+static double wall_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [-n <graines par configuration (défaut 10)>] [-s <graine>] [-o <fichier CSV>]\n"
+           "          [-b <CSV de référence>] [-t <tolérance (%%, défaut 5)>] [-x <scénario>] [-v]\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    int seeds = 10;
+    uint64_t base_seed = 1;
+    const char *output = NULL, *baseline = NULL;
+    double tolerance = 5;
+    int only = -1, verbose = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:o:b:t:x:vh")) != -1) {
+        switch (opt) {
+        case 'n': seeds = atoi(optarg); break;
+        case 's': base_seed = strtoull(optarg, NULL, 10); break;
+        case 'o': output = optarg; break;
+        case 'b': baseline = optarg; break;
+        case 't': tolerance = atof(optarg); break;
+        case 'x': only = atoi(optarg); break;
+        case 'v': verbose = 1; break;
+        default:
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+    if (seeds <= 0 || tolerance < 0) {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    size_t max_scenarios = 2 * NUM_PROFILES * NUM_LOSSES * NUM_SIZES * (size_t)seeds;
+    Scenario *suite = malloc(max_scenarios * sizeof(Scenario));
+    Result *results = calloc(max_scenarios, sizeof(Result));
+    size_t max_size = 0;
+    for (size_t z = 0; z < NUM_SIZES; z++) {
+        if (sizes[z] > max_size) max_size = sizes[z];
+    }
+    uint8_t *file = malloc(max_size + 1);
+    Sim sim;
+    memset(&sim, 0, sizeof(sim));
+    sim.capacity = max_size + LIBTFTP_BLOCK_SIZE;
+    sim.received = malloc(sim.capacity);
+    if (suite == NULL || results == NULL || file == NULL || sim.received == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    sim.verbose = verbose;
+    sim.client_addr.sin_family = AF_INET;
+    sim.client_addr.sin_addr.s_addr = htonl(0x0A000001); // 10.0.0.1
+    sim.client_addr.sin_port = htons(SIM_CLIENT_PORT);
+    sim.server_addr.sin_family = AF_INET;
+    sim.server_addr.sin_addr.s_addr = htonl(0x0A000002); // 10.0.0.2
+    sim.server_addr.sin_port = htons(SIM_SERVER_PORT);
+
+    size_t n = build_suite(suite, seeds, base_seed);
+    if (only >= (int)n) {
+        fprintf(stderr, "Scénario %d inexistant (0-%zu)\n", only, n - 1);
+        exit(1);
+    }
+
+    FILE *out = stdout;
+    if (output != NULL && (out = fopen(output, "w")) == NULL) {
+        perror(output);
+        exit(1);
+    }
+    print_header(out);
+
+    size_t counts[3] = { 0, 0, 0 };
+    unsigned long packets = 0;
+    double start = wall_ms();
+    for (size_t i = 0; i < n; i++) {
+        const Scenario *sc = &suite[i];
+        if (only >= 0 && sc->id != only) {
+            continue;
+        }
+        // Contenu du fichier propre au scénario
+        uint64_t state = sc->seed;
+        for (size_t j = 0; j < sc->size; j += 8) {
+            uint64_t v = rng_next(&state);
+            memcpy(file + j, &v, sc->size - j < 8 ? sc->size - j : 8);
+        }
+        if (run_scenario(&sim, sc, file, &results[i]) == -1) {
+            perror("Erreur lors de la création du transfert");
+            exit(1);
+        }
+        print_result(out, sc, &results[i]);
+        counts[results[i].status]++;
+        packets += results[i].packets;
+    }
+    double elapsed = wall_ms() - start;
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    size_t total = counts[RESULT_OK] + counts[RESULT_FAILED] + counts[RESULT_CORRUPT];
+    fprintf(stderr, "%zu scénarios en %.1f ms (%.0f scénarios/s, %.2f M paquets/s) : %zu ok, %zu en échec, %zu corrompus\n",
+            total, elapsed, elapsed > 0 ? total / elapsed * 1000 : 0.0, elapsed > 0 ? packets / elapsed / 1000 : 0.0,
+            counts[RESULT_OK], counts[RESULT_FAILED], counts[RESULT_CORRUPT]);
+
+    int failed = counts[RESULT_CORRUPT] > 0;
+    if (baseline != NULL && only < 0) {
+        failed |= compare_baseline(baseline, suite, results, n, tolerance) != 0;
+    }
+
+    while (sim.free_packets != NULL) {
+        SimPacket *p = sim.free_packets;
+        sim.free_packets = p->next;
+        free(p);
+    }
+    free(sim.heap);
+    free(sim.received);
+    free(file);
+    free(results);
+    free(suite);
+    return failed ? 1 : 0;
+}
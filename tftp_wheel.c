@@ -0,0 +1,151 @@
+#define _GNU_SOURCE
+#include <string.h>
+
+#include "tftp_wheel.h"
+
+// Une temporisation d'échéance e est rangée au niveau du chiffre (en base
+// WHEEL_SLOTS) le plus significatif où e diffère de l'heure courante, dans la
+// case de ce chiffre de e. Quand l'heure courante atteint cette case, la
+// temporisation est reclassée à un niveau inférieur (ou échue au niveau 0).
+// Les cases occupées sont marquées dans un masque par niveau : la roue saute
+// directement au prochain reclassement, sans travail pour les millisecondes
+// où rien n'arrive à échéance. Ajout et annulation sont en O(1).
+
+#define DUE_LEVEL WHEEL_LEVELS
+
+static unsigned digit(uint64_t time, int level) {
+    return (time >> (level * WHEEL_BITS)) & (WHEEL_SLOTS - 1);
+}
+
+static void link_timer(TFTP_Timer **head, TFTP_Timer *t) {
+    t->next = *head;
+    if (t->next != NULL) {
+        t->next->pprev = &t->next;
+    }
+    t->pprev = head;
+    *head = t;
+}
+
+static void insert(TFTP_Wheel *w, TFTP_Timer *t) {
+    if (t->expires <= w->now) {
+        t->level = DUE_LEVEL;
+        link_timer(&w->due, t);
+        return;
+    }
+    uint64_t diff = t->expires ^ w->now;
+    int level = (63 - __builtin_clzll(diff)) / WHEEL_BITS;
+    unsigned slot = digit(t->expires, level);
+    t->level = (uint8_t)level;
+    t->slot = (uint8_t)slot;
+    link_timer(&w->slots[level][slot], t);
+    w->occupied[level] |= (uint64_t)1 << slot;
+}
+
+void wheel_init(TFTP_Wheel *w, uint64_t now) {
+    memset(w, 0, sizeof(*w));
+    w->now = now;
+}
+
+void wheel_add(TFTP_Wheel *w, TFTP_Timer *t, uint64_t expires) {
+    wheel_cancel(w, t);
+    // Limitation à la plage couverte par le niveau le plus haut
+    uint64_t limit = w->now | (WHEEL_RANGE_MS - 1);
+    t->expires = expires < limit ? expires : limit;
+    insert(w, t);
+}
+
+void wheel_cancel(TFTP_Wheel *w, TFTP_Timer *t) {
+    if (t->pprev == NULL) {
+        return;
+    }
+    *t->pprev = t->next;
+    if (t->next != NULL) {
+        t->next->pprev = t->pprev;
+    }
+    if (t->level != DUE_LEVEL && w->slots[t->level][t->slot] == NULL) {
+        w->occupied[t->level] &= ~((uint64_t)1 << t->slot);
+    }
+    t->next = NULL;
+    t->pprev = NULL;
+}
+
+int wheel_pending(const TFTP_Timer *t) {
+    return t->pprev != NULL;
+}
+
+// Heure du prochain reclassement ou de la prochaine échéance, UINT64_MAX si la roue est vide
+static uint64_t next_event(const TFTP_Wheel *w) {
+    uint64_t best = UINT64_MAX;
+    for (int level = 0; level < WHEEL_LEVELS; level++) {
+        unsigned cur = digit(w->now, level);
+        if (cur == WHEEL_SLOTS - 1) {
+            continue;
+        }
+        uint64_t ahead = w->occupied[level] & (~(uint64_t)0 << (cur + 1));
+        if (ahead == 0) {
+            continue;
+        }
+        unsigned slot = __builtin_ctzll(ahead);
+        int shift = (level + 1) * WHEEL_BITS;
+        uint64_t base = shift < 64 ? (w->now >> shift) << shift : 0;
+        uint64_t time = base | ((uint64_t)slot << (level * WHEEL_BITS));
+        if (time < best) {
+            best = time;
+        }
+    }
+    return best;
+}
+
+int wheel_timeout(const TFTP_Wheel *w, uint64_t now) {
+    if (w->due != NULL) {
+        return 0;
+    }
+    uint64_t next = next_event(w);
+    if (next == UINT64_MAX) {
+        return -1;
+    }
+    if (next <= now) {
+        return 0;
+    }
+    uint64_t delay = next - now;
+    return delay > 0x7FFFFFFF ? 0x7FFFFFFF : (int)delay;
+}
+
+static void advance(TFTP_Wheel *w, uint64_t now) {
+    uint64_t next;
+    while ((next = next_event(w)) <= now) {
+        w->now = next;
+        // Reclassement des cases atteintes, du niveau le plus haut au plus bas
+        for (int level = WHEEL_LEVELS - 1; level >= 0; level--) {
+            if (level > 0 && (next & (((uint64_t)1 << (level * WHEEL_BITS)) - 1)) != 0) {
+                continue;
+            }
+            unsigned slot = digit(next, level);
+            TFTP_Timer *list = w->slots[level][slot];
+            if (list == NULL) {
+                continue;
+            }
+            w->slots[level][slot] = NULL;
+            w->occupied[level] &= ~((uint64_t)1 << slot);
+            while (list != NULL) {
+                TFTP_Timer *t = list;
+                list = t->next;
+                insert(w, t);
+            }
+        }
+    }
+    if (now > w->now) {
+        w->now = now;
+    }
+}
+
+TFTP_Timer *wheel_expired(TFTP_Wheel *w, uint64_t now) {
+    if (w->due == NULL) {
+        advance(w, now);
+    }
+    TFTP_Timer *t = w->due;
+    if (t != NULL) {
+        wheel_cancel(w, t);
+    }
+    return t;
+}
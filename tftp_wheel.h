@@ -0,0 +1,40 @@
+#ifndef TFTP_WHEEL_H
+#define TFTP_WHEEL_H
+
+#include <stdint.h>
+
+// Roue de temporisations hiérarchique : WHEEL_LEVELS niveaux de WHEEL_SLOTS
+// cases, résolution d'une milliseconde. Une échéance plus lointaine que
+// WHEEL_RANGE_MS (2^36 ms, ~795 jours) est ramenée à la fin de la plage couverte.
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 6
+#define WHEEL_RANGE_MS ((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS))
+
+// Temporisation à inclure dans l'objet qui l'utilise
+typedef struct TFTP_Timer {
+    struct TFTP_Timer *next;
+    struct TFTP_Timer **pprev; // NULL si la temporisation n'est pas armée
+    uint64_t expires;
+    uint8_t level;
+    uint8_t slot;
+} TFTP_Timer;
+
+typedef struct {
+    uint64_t now;
+    uint64_t occupied[WHEEL_LEVELS]; // une case non vide par bit
+    TFTP_Timer *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+    TFTP_Timer *due;                 // échues, pas encore rendues à l'appelant
+} TFTP_Wheel;
+
+void wheel_init(TFTP_Wheel *w, uint64_t now);
+void wheel_add(TFTP_Wheel *w, TFTP_Timer *t, uint64_t expires);
+void wheel_cancel(TFTP_Wheel *w, TFTP_Timer *t);
+int wheel_pending(const TFTP_Timer *t);
+
+// Délai en ms avant le prochain passage nécessaire (0 : immédiat, -1 : aucune temporisation)
+int wheel_timeout(const TFTP_Wheel *w, uint64_t now);
+// Avance la roue jusqu'à now et retourne une temporisation échue (désarmée), NULL s'il n'y en a plus
+TFTP_Timer *wheel_expired(TFTP_Wheel *w, uint64_t now);
+
+#endif
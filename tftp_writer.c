@@ -0,0 +1,404 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "tftp_writer.h"
+
+// Écriture différée des blocs reçus (WRQ). Les blocs sont copiés dans un
+// tampon de WRITER_BUFFER_SIZE octets ; chaque tampon plein reçoit l'offset
+// suivant du fichier et part dans la file d'un groupe de threads partagé,
+// qui l'écrit en une seule pwrite() puis le libère. Une session sans bloc en
+// cours ne garde donc aucun tampon.
+//
+// La boucle d'événements n'attend jamais le disque : avec WRITER_BUFFERS
+// tampons déjà en écriture, writer_queue() garde le bloc et retourne 1 ; la
+// fin d'une écriture est alors signalée par un eventfd (writer_fd) et
+// writer_process() appelle wake(owner).
+
+typedef struct TFTP_WriteJob {
+    struct TFTP_Writer *w;
+    char *buf;
+    size_t len;
+    off_t offset;
+    int busy;          // en file ou en cours d'écriture
+    struct TFTP_WriteJob *next_job;
+} TFTP_WriteJob;
+
+struct TFTP_Writer {
+    int fd;                 // copie du descripteur, fermée avec le writer
+    void *owner;
+    TFTP_WriteJob jobs[WRITER_BUFFERS];
+    TFTP_WriteJob *current; // tampon en cours de remplissage, NULL si aucun
+    off_t offset;           // offset du prochain tampon soumis
+    int in_flight;
+    int err;                // errno de la première écriture en échec
+    int waiting;            // la session attend un tampon libre ou la fin des écritures
+    int closing;            // libéré par la session : la dernière écriture le détruit
+    int ready_queued;
+    struct TFTP_Writer *next_ready;
+    // Données reçues alors que tous les tampons étaient en écriture
+    char *spill;
+    size_t spill_len, spill_size;
+};
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    TFTP_WriteJob *queue_head, *queue_tail;
+    TFTP_Writer *ready_head;   // writers à relancer par writer_process()
+    int started;
+    int event_fd;
+    void (*wake)(void *owner);
+} pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .work = PTHREAD_COND_INITIALIZER,
+    .event_fd = -1,
+};
+
+static void destroy(TFTP_Writer *w) {
+    for (int i = 0; i < WRITER_BUFFERS; i++) {
+        free(w->jobs[i].buf);
+    }
+    free(w->spill);
+    close(w->fd);
+    free(w);
+}
+
+// Signale à la boucle d'événements que la session peut reprendre. Appelé
+// verrou pris ; retourne 1 si l'eventfd doit être incrémenté.
+static int notify(TFTP_Writer *w) {
+    if (!w->waiting) {
+        return 0;
+    }
+    w->waiting = 0;
+    if (w->ready_queued) {
+        return 0;
+    }
+    w->ready_queued = 1;
+    w->next_ready = pool.ready_head;
+    pool.ready_head = w;
+    return 1;
+}
+
+static void *writer_thread(void *arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&pool.lock);
+    while (1) {
+        while (pool.queue_head == NULL) {
+            pthread_cond_wait(&pool.work, &pool.lock);
+        }
+        TFTP_WriteJob *job = pool.queue_head;
+        pool.queue_head = job->next_job;
+        if (pool.queue_head == NULL) {
+            pool.queue_tail = NULL;
+        }
+        TFTP_Writer *w = job->w;
+        // Après une erreur les tampons sont seulement libérés
+        int failed = w->err != 0;
+        pthread_mutex_unlock(&pool.lock);
+
+        int err = 0;
+        size_t done = 0;
+        while (!failed && done < job->len) {
+            ssize_t n = pwrite(w->fd, job->buf + done, job->len - done, job->offset + done);
+            if (n == -1 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                err = n == 0 ? ENOSPC : errno;
+                break;
+            }
+            done += n;
+        }
+        free(job->buf);
+        job->buf = NULL;
+
+        pthread_mutex_lock(&pool.lock);
+        if (err != 0 && w->err == 0) {
+            w->err = err;
+        }
+        job->busy = 0;
+        w->in_flight--;
+
+        if (w->closing) {
+            if (w->in_flight == 0) {
+                pthread_mutex_unlock(&pool.lock);
+                destroy(w);
+                pthread_mutex_lock(&pool.lock);
+            }
+        } else if (notify(w)) {
+            uint64_t one = 1;
+            ssize_t ret = write(pool.event_fd, &one, sizeof(one));
+            (void)ret; // compteur saturé : la boucle a déjà un réveil en attente
+        }
+    }
+    return NULL;
+}
+
+// Démarrage des threads au premier WRQ
+static int start_pool(void) {
+    if (pool.started) {
+        return 0;
+    }
+    for (int i = 0; i < WRITER_THREADS; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, writer_thread, NULL) != 0) {
+            return i == 0 ? -1 : 0;
+        }
+        pthread_detach(thread);
+    }
+    pool.started = 1;
+    return 0;
+}
+
+int writer_init(void (*wake)(void *owner)) {
+    if (pool.event_fd == -1) {
+        pool.event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (pool.event_fd == -1) {
+            return -1;
+        }
+    }
+    pool.wake = wake;
+    return 0;
+}
+
+int writer_fd(void) {
+    return pool.event_fd;
+}
+
+void writer_process(void) {
+    uint64_t count;
+    if (read(pool.event_fd, &count, sizeof(count)) == -1) {
+        return;
+    }
+
+    while (1) {
+        pthread_mutex_lock(&pool.lock);
+        TFTP_Writer *w = pool.ready_head;
+        if (w != NULL) {
+            pool.ready_head = w->next_ready;
+            w->ready_queued = 0;
+        }
+        pthread_mutex_unlock(&pool.lock);
+        if (w == NULL) {
+            break;
+        }
+        // Seule la boucle d'événements libère un writer actif : w reste valide ici
+        pool.wake(w->owner);
+    }
+}
+
+TFTP_Writer *writer_new(int fd, void *owner) {
+    if (pool.event_fd == -1) {
+        errno = EINVAL;
+        return NULL;
+    }
+    pthread_mutex_lock(&pool.lock);
+    int ret = start_pool();
+    pthread_mutex_unlock(&pool.lock);
+    if (ret == -1) {
+        return NULL;
+    }
+
+    TFTP_Writer *w = calloc(1, sizeof(TFTP_Writer));
+    if (w == NULL) {
+        return NULL;
+    }
+    // Copie du descripteur : une écriture peut finir après la fermeture de la session
+    w->fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (w->fd == -1) {
+        free(w);
+        return NULL;
+    }
+    w->owner = owner;
+    for (int i = 0; i < WRITER_BUFFERS; i++) {
+        w->jobs[i].w = w;
+    }
+    return w;
+}
+
+// Passe le tampon courant aux threads d'écriture, à l'offset suivant du fichier
+static void submit_current(TFTP_Writer *w) {
+    TFTP_WriteJob *job = w->current;
+    w->current = NULL;
+
+    pthread_mutex_lock(&pool.lock);
+    job->offset = w->offset;
+    w->offset += job->len;
+    job->busy = 1;
+    job->next_job = NULL;
+    if (pool.queue_tail) {
+        pool.queue_tail->next_job = job;
+    } else {
+        pool.queue_head = job;
+    }
+    pool.queue_tail = job;
+    w->in_flight++;
+    pthread_cond_signal(&pool.work);
+    pthread_mutex_unlock(&pool.lock);
+}
+
+// Copie autant de données que possible dans les tampons. Retourne 1 s'il en
+// reste faute de tampon libre (la session sera réveillée), -1 sans mémoire.
+static int fill(TFTP_Writer *w, const char **data, size_t *len) {
+    while (*len > 0) {
+        if (w->current == NULL) {
+            pthread_mutex_lock(&pool.lock);
+            for (int i = 0; i < WRITER_BUFFERS && w->current == NULL; i++) {
+                if (!w->jobs[i].busy) {
+                    w->current = &w->jobs[i];
+                }
+            }
+            w->waiting = w->current == NULL;
+            pthread_mutex_unlock(&pool.lock);
+            if (w->current == NULL) {
+                return 1;
+            }
+            // Tampon alloué au premier bloc, aligné sur une page pour des écritures alignées
+            if (posix_memalign((void **)&w->current->buf, 4096, WRITER_BUFFER_SIZE) != 0) {
+                w->current->buf = NULL;
+                w->current = NULL;
+                errno = ENOMEM;
+                return -1;
+            }
+            w->current->len = 0;
+        }
+
+        size_t room = WRITER_BUFFER_SIZE - w->current->len;
+        size_t n = *len < room ? *len : room;
+        memcpy(w->current->buf + w->current->len, *data, n);
+        w->current->len += n;
+        *data += n;
+        *len -= n;
+        if (w->current->len == WRITER_BUFFER_SIZE) {
+            submit_current(w);
+        }
+    }
+    return 0;
+}
+
+// Garde des données en attente d'un tampon libre
+static int spill(TFTP_Writer *w, const char *data, size_t len) {
+    if (len == 0) {
+        return 0;
+    }
+    if (w->spill_len + len > w->spill_size) {
+        char *p = realloc(w->spill, w->spill_len + len);
+        if (p == NULL) {
+            return -1;
+        }
+        w->spill = p;
+        w->spill_size = w->spill_len + len;
+    }
+    memcpy(w->spill + w->spill_len, data, len);
+    w->spill_len += len;
+    return 0;
+}
+
+int writer_queue(TFTP_Writer *w, const void *data, size_t len) {
+    int err = writer_error(w);
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+
+    // Données gardées à l'appel précédent d'abord, pour conserver l'ordre
+    if (w->spill_len > 0) {
+        const char *p = w->spill;
+        size_t n = w->spill_len;
+        int ret = fill(w, &p, &n);
+        memmove(w->spill, p, n);
+        w->spill_len = n;
+        if (ret == -1) {
+            return -1;
+        }
+        if (ret == 1) {
+            return spill(w, data, len) == -1 ? -1 : 1;
+        }
+    }
+
+    const char *p = data;
+    int ret = fill(w, &p, &len);
+    if (ret == 1 && spill(w, p, len) == -1) {
+        return -1;
+    }
+    return ret;
+}
+
+int writer_finish(TFTP_Writer *w) {
+    int ret = writer_queue(w, NULL, 0);
+    if (ret != 0) {
+        return ret;
+    }
+    if (w->current != NULL && w->current->len > 0) {
+        submit_current(w);
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    int in_flight = w->in_flight;
+    w->waiting = in_flight > 0;
+    int err = w->err;
+    pthread_mutex_unlock(&pool.lock);
+
+    if (in_flight > 0) {
+        return 1;
+    }
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+int writer_error(const TFTP_Writer *w) {
+    pthread_mutex_lock(&pool.lock);
+    int err = w->err;
+    pthread_mutex_unlock(&pool.lock);
+    return err;
+}
+
+void writer_free(TFTP_Writer *w) {
+    if (w == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    // Retrait des écritures pas encore commencées
+    TFTP_WriteJob **pp = &pool.queue_head;
+    pool.queue_tail = NULL;
+    while (*pp != NULL) {
+        if ((*pp)->w == w) {
+            (*pp)->busy = 0;
+            w->in_flight--;
+            *pp = (*pp)->next_job;
+        } else {
+            pool.queue_tail = *pp;
+            pp = &(*pp)->next_job;
+        }
+    }
+    if (w->ready_queued) {
+        TFTP_Writer **wp = &pool.ready_head;
+        while (*wp != w) {
+            wp = &(*wp)->next_ready;
+        }
+        *wp = w->next_ready;
+        w->ready_queued = 0;
+    }
+    w->waiting = 0;
+    w->closing = 1;
+    int in_flight = w->in_flight;
+    pthread_mutex_unlock(&pool.lock);
+
+    // Sinon la dernière écriture en cours libère le writer (destroy() ne
+    // touche qu'aux tampons qui ne sont plus en écriture)
+    if (in_flight == 0) {
+        destroy(w);
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef TFTP_WRITER_H
+#define TFTP_WRITER_H
+
+#include <stddef.h>
+
+// Nombre de tampons en écriture par session et taille de chacun (multiple de 4096)
+#define WRITER_BUFFERS 4
+#define WRITER_BUFFER_SIZE (64 * 1024)
+// Nombre de threads d'écriture partagés par toutes les sessions
+#define WRITER_THREADS 2
+
+typedef struct TFTP_Writer TFTP_Writer;
+
+// wake(owner) est appelée par writer_process() quand un writer qui a
+// retourné 1 (file pleine ou écritures en cours) peut être relancé
+int writer_init(void (*wake)(void *owner));
+// eventfd à surveiller
+int writer_fd(void);
+void writer_process(void);
+
+TFTP_Writer *writer_new(int fd, void *owner);
+// 0 : données prises ; 1 : données gardées mais file pleine, rappeler
+// writer_queue(w, NULL, 0) après wake(owner) ; -1 : erreur (errno)
+int writer_queue(TFTP_Writer *w, const void *data, size_t len);
+// Toutes les données écrites : 0 ; 1 : écritures en cours, rappeler après
+// wake(owner) ; -1 : erreur d'écriture (errno)
+int writer_finish(TFTP_Writer *w);
+int writer_error(const TFTP_Writer *w);
+// Ne bloque pas ; les écritures encore en file sont abandonnées
+void writer_free(TFTP_Writer *w);
+
+#endif